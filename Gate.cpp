@@ -1,127 +1,2734 @@
 #include <thread>
+#include <atomic>
+#include <mutex>
 #include <condition_variable>
 #include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <cerrno>
+#include <climits>
+#include <algorithm>
+#include <vector>
+#include <system_error>
+#include <stdexcept>
+#include <optional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <functional>
+#include <cstring>
+#include <string>
 #include <iostream>
 
+// The file needs C++17: std::optional, std::launder and fold expressions. Coroutines and stop tokens need C++20
+#ifdef __cpp_impl_coroutine
+#include <coroutine>
+#endif
+
+#if __cplusplus >= 202002L
+#include <stop_token>
+#endif
+
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+// Thin wrappers over the Linux futex syscall. Every gate keeps its whole state in one 32-bit atomic word,
+// so the kernel is entered only when a thread really has to sleep or has to be woken up
+namespace Futex
+{
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Futex word must be exactly 32 bits");
+
+#ifdef __linux__
+    // Blocks the thread while the word is equal to expected or until the relative timeout expires.
+    // Returns false only on timeout. Wakeups may be spurious, so the caller must re-check the word
+    inline bool Wait(std::atomic<uint32_t>& word, uint32_t expected, const timespec* timeout = nullptr)
+    {
+        long res = syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, timeout, nullptr, 0);
+        return !(res == -1 && errno == ETIMEDOUT);
+    }
+
+    // Blocks the thread while the word is equal to expected or until the absolute deadline on CLOCK_MONOTONIC.
+    // Returns false only on timeout. The kernel measures the deadline itself, so spurious wakeups don't need to read the clock
+    inline bool WaitUntil(std::atomic<uint32_t>& word, uint32_t expected, const timespec& deadline)
+    {
+        long res = syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_BITSET_PRIVATE, expected, &deadline, nullptr, FUTEX_BITSET_MATCH_ANY);
+        return !(res == -1 && errno == ETIMEDOUT);
+    }
+
+#if defined(SYS_futex_waitv) && defined(FUTEX_WAITV_MAX)
+    // Returns true if the kernel has the futex_waitv syscall of Linux 5.16. The kernel is asked once per process: 
+    // an empty vector is rejected with EINVAL by a kernel that knows the syscall and with ENOSYS by an older one
+    inline bool IsWaitManySupported()
+    {
+        static const bool isSupported = syscall(SYS_futex_waitv, nullptr, 0, 0, nullptr, CLOCK_MONOTONIC) == -1 && errno == EINVAL;
+        return isSupported;
+    }
+
+    // Blocks the thread while each word of the vector is equal to its expected value, at most FUTEX_WAITV_MAX words, 
+    // or until the absolute deadline on CLOCK_MONOTONIC. Returns false only on timeout. Wakeups may be spurious
+    inline bool WaitMany(futex_waitv* waiters, unsigned count, const timespec* deadline = nullptr)
+    {
+        long res = syscall(SYS_futex_waitv, waiters, count, 0, deadline, CLOCK_MONOTONIC);
+        return !(res == -1 && errno == ETIMEDOUT);
+    }
+#endif
+
+    // Wakes up to count threads sleeping on the word
+    inline void Wake(std::atomic<uint32_t>& word, int count = 1)
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+    }
+#else
+    // Portable fallback for systems without futexes. Words are waited on through a table of mutexes and condition 
+    // variables hashed by the address of the word. Wake takes the mutex of the bucket, so it can't slip in between 
+    // the check of the word and the sleep of the waiting thread
+    struct Bucket
+    {
+        std::mutex Mutex;
+        std::condition_variable Cv;
+    };
+
+    inline Bucket& BucketOf(const void* address)
+    {
+        static Bucket buckets[64];
+        return buckets[(reinterpret_cast<uintptr_t>(address) >> 4) % 64];
+    }
+
+    // Blocks the thread while the word is equal to expected or until the relative timeout expires.
+    // Returns false only on timeout. Wakeups may be spurious, so the caller must re-check the word
+    inline bool Wait(std::atomic<uint32_t>& word, uint32_t expected, const timespec* timeout = nullptr)
+    {
+        Bucket& bucket = BucketOf(&word);
+        std::unique_lock<std::mutex> lk(bucket.Mutex);
+        if (word.load(std::memory_order_relaxed) != expected)
+            return true;
+
+        if (timeout == nullptr)
+        {
+            bucket.Cv.wait(lk);
+            return true;
+        }
+        return bucket.Cv.wait_for(lk, std::chrono::seconds(timeout->tv_sec) + std::chrono::nanoseconds(timeout->tv_nsec)) == std::cv_status::no_timeout;
+    }
+
+    // Blocks the thread while the word is equal to expected or until the absolute deadline on the steady clock. 
+    // Returns false only on timeout
+    inline bool WaitUntil(std::atomic<uint32_t>& word, uint32_t expected, const timespec& deadline)
+    {
+        Bucket& bucket = BucketOf(&word);
+        std::unique_lock<std::mutex> lk(bucket.Mutex);
+        if (word.load(std::memory_order_relaxed) != expected)
+            return true;
+
+        std::chrono::steady_clock::time_point timePoint(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::seconds(deadline.tv_sec) + std::chrono::nanoseconds(deadline.tv_nsec)));
+        return bucket.Cv.wait_until(lk, timePoint) == std::cv_status::no_timeout;
+    }
+
+    // Wakes the threads sleeping on the word. A bucket is shared by several words, so all its threads are woken
+    inline void Wake(std::atomic<uint32_t>& word, int = 1)
+    {
+        Bucket& bucket = BucketOf(&word);
+        std::lock_guard<std::mutex> lk(bucket.Mutex);
+        bucket.Cv.notify_all();
+    }
+#endif
+
+    // Converts a duration to the timespec format of the futex syscall. Negative durations, like deadlines before boot, 
+    // become zero: the kernel rejects a negative timespec with EINVAL, which would never count as a timeout
+    template<class Rep, class Period>
+    timespec ToTimespec(std::chrono::duration<Rep, Period> duration)
+    {
+        auto ns = std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), 0);
+        timespec ts;
+        ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+        ts.tv_nsec = static_cast<long>(ns % 1000000000);
+        return ts;
+    }
+
+    // Returns the duration rounded up to the steady_clock precision, so a deadline never comes early
+    template<class Rep, class Period>
+    std::chrono::steady_clock::duration CeilToSteady(const std::chrono::duration<Rep, Period>& duration)
+    {
+        auto rounded = std::chrono::duration_cast<std::chrono::steady_clock::duration>(duration);
+        if (rounded < duration)
+            rounded += std::chrono::steady_clock::duration(1);
+        return rounded;
+    }
+
+    // Returns the time point as an absolute CLOCK_MONOTONIC deadline. On Linux steady_clock is CLOCK_MONOTONIC, 
+    // so its time points are used as they are, without reading any clock
+    template<class Duration>
+    std::chrono::steady_clock::time_point ToSteady(const std::chrono::time_point<std::chrono::steady_clock, Duration>& timePoint)
+    {
+        return std::chrono::steady_clock::time_point(CeilToSteady(timePoint.time_since_epoch()));
+    }
+
+    // Returns the time point of another clock as an absolute CLOCK_MONOTONIC deadline. The distance to the time point 
+    // is measured once, so later steps of the other clock, like NTP corrections of system_clock, don't move the deadline
+    template<class Clock, class Duration>
+    std::chrono::steady_clock::time_point ToSteady(const std::chrono::time_point<Clock, Duration>& timePoint)
+    {
+        return std::chrono::steady_clock::now() + CeilToSteady(timePoint - Clock::now());
+    }
+}
+
+// Hints the processor that the thread is in a spin-wait loop
+inline void CpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield" ::: "memory");
+#else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+// This class implements the waiting policy of a closing thread: spin with pause hints for a short budget 
+// and only then park in the kernel. The budget follows the length of recent waits the way the glibc adaptive mutex 
+// tunes __spins: every wait moves the estimate 1/8 of the way towards the iterations it spun, so waits that ended 
+// while spinning pull it towards their length and waits that spent the whole budget push it towards the limit. 
+// Spinning is skipped on single processor machines, where the opening thread can't run while we spin
+class AdaptiveSpin
+{
+public:
+    // Default upper bound of the spin budget in pause iterations, the same as glibc uses for adaptive mutexes
+    static constexpr uint32_t DefaultLimit = 100;
+private:
+    std::atomic<uint32_t> Limit{DefaultLimit};
+    std::atomic<uint32_t> Estimate{0};
+public:
+    // Spins until the predicate returns true or the budget is spent. Returns true if the predicate was satisfied.
+    // Called only by the closing thread, so the estimate is updated with relaxed stores
+    template<class Predicate>
+    bool Spin(Predicate isReady)
+    {
+        static const bool isMultiprocessor = std::thread::hardware_concurrency() > 1;
+
+        uint32_t limit = Limit.load(std::memory_order_relaxed);
+        if (!isMultiprocessor || limit == 0)
+            return false;
+
+        uint32_t estimate = Estimate.load(std::memory_order_relaxed);
+        uint32_t budget = std::min(limit, estimate * 2 + 10);
+        uint32_t spins = 0;
+        bool isSatisfied = false;
+        for (; spins < budget; ++spins)
+        {
+            if (isReady())
+            {
+                isSatisfied = true;
+                break;
+            }
+            CpuRelax();
+        }
+
+        Estimate.store(static_cast<uint32_t>(estimate + (static_cast<int64_t>(spins) - estimate) / 8), std::memory_order_relaxed);
+        return isSatisfied;
+    }
+
+    // Sets the maximum amount of pause iterations spent before parking. Zero disables spinning
+    void SetLimit(uint32_t limit)
+    {
+        Limit.store(limit, std::memory_order_relaxed);
+    }
+
+    // Returns the maximum amount of pause iterations spent before parking
+    uint32_t GetLimit() const
+    {
+        return Limit.load(std::memory_order_relaxed);
+    }
+};
+
+// Continuation that a gate runs on Open instead of waking a sleeping thread. The node lives inside the object 
+// that waits, like a coroutine awaiter, so registering it allocates nothing. Resume runs on the thread that opens the gate
+struct GateWaiter
+{
+    void (*Resume)(GateWaiter*) = nullptr;
+};
+
+// Type-erased callable for gate continuations. Callables up to InlineSize bytes are stored inside the object, 
+// larger ones on the heap. Run moves the callable out before calling it, so the callable may store a new one
+class GateContinuation
+{
+private:
+    static constexpr size_t InlineSize = 6 * sizeof(void*);
+
+    alignas(std::max_align_t) unsigned char Storage[InlineSize];
+    void* Target = nullptr;
+    void (*Invoke)(void*) = nullptr;
+    void (*Destroy)(void*) = nullptr;
+
+    template<class F>
+    static constexpr bool IsInline = sizeof(F) <= InlineSize && alignof(F) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<F>;
+
+    template<class F>
+    static void InvokeInline(void* target)
+    {
+        F* stored = static_cast<F*>(target);
+        F callable(std::move(*stored));
+        stored->~F();
+        callable();
+    }
+
+    template<class F>
+    static void DestroyInline(void* target)
+    {
+        static_cast<F*>(target)->~F();
+    }
+
+    template<class F>
+    static void InvokeHeap(void* target)
+    {
+        std::unique_ptr<F> callable(static_cast<F*>(target));
+        (*callable)();
+    }
+
+    template<class F>
+    static void DestroyHeap(void* target)
+    {
+        delete static_cast<F*>(target);
+    }
+public:
+    GateContinuation() = default;
+    GateContinuation(const GateContinuation&) = delete;
+    GateContinuation& operator=(const GateContinuation&) = delete;
+
+    ~GateContinuation()
+    {
+        Reset();
+    }
+
+    // Stores the callable, destroying the previous one
+    template<class F>
+    void Set(F&& callable)
+    {
+        using Callable = std::decay_t<F>;
+        Reset();
+        if constexpr (IsInline<Callable>)
+        {
+            Target = new (Storage) Callable(std::forward<F>(callable));
+            Invoke = &InvokeInline<Callable>;
+            Destroy = &DestroyInline<Callable>;
+        }
+        else
+        {
+            Target = new Callable(std::forward<F>(callable));
+            Invoke = &InvokeHeap<Callable>;
+            Destroy = &DestroyHeap<Callable>;
+        }
+    }
+
+    // Calls the stored callable and leaves the object empty
+    void Run()
+    {
+        void* target = Target;
+        Target = nullptr;
+        Invoke(target);
+    }
+
+    // Destroys the stored callable without calling it
+    void Reset()
+    {
+        if (Target == nullptr)
+            return;
+
+        Destroy(Target);
+        Target = nullptr;
+    }
+};
+
+#if defined(__cpp_lib_jthread) && defined(__cpp_concepts)
+// Base of the operation states of the gate senders, see Gate::AsyncCloseSender. The receiver is completed 
+// like a std::execution receiver, with set_value or set_stopped, and may provide get_stop_token() to make 
+// the operation cancellable. Open, the deadline and the stop request race for the gate word, and only the winner 
+// completes the receiver. Derived provides Park, Unpark, ArmDeadline, CancelDeadline and Complete
+template<class Derived, class Receiver>
+class GateOperation : protected GateWaiter
+{
+protected:
+    enum class Outcome { Opened, TimedOut, Stopped };
+
+    struct StopHandler
+    {
+        GateOperation* Operation;
+
+        void operator()() const noexcept
+        {
+            Operation->OnStopRequested();
+        }
+    };
+
+    Receiver Rcvr;
+    std::atomic<uint32_t> References{0};
+    Outcome Result = Outcome::Opened;
+    std::optional<std::stop_callback<StopHandler>> OnStop;
+
+    explicit GateOperation(Receiver&& rcvr) : Rcvr(std::move(rcvr)) {}
+
+    Derived& Self()
+    {
+        return static_cast<Derived&>(*this);
+    }
+
+    std::stop_token GetStopToken() const
+    {
+        if constexpr (requires(const Receiver& rcvr) { { rcvr.get_stop_token() } -> std::convertible_to<std::stop_token>; })
+            return Rcvr.get_stop_token();
+        else
+            return std::stop_token();
+    }
+
+    // Drops a reference. The last one completes the receiver, after which the operation may be destroyed
+    void Release()
+    {
+        if (References.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+
+        OnStop.reset();
+        Self().CancelDeadline();
+        if (Result == Outcome::Stopped)
+            std::move(Rcvr).set_stopped();
+        else
+            Self().Complete(Result == Outcome::Opened);
+    }
+
+    // Called by the completion source that won the gate word
+    void Finish(Outcome outcome)
+    {
+        Result = outcome;
+        Release();
+    }
+
+    void OnStopRequested()
+    {
+        if (Self().Unpark())
+            Finish(Outcome::Stopped);
+    }
+
+    void OnDeadline()
+    {
+        if (Self().Unpark())
+            Finish(Outcome::TimedOut);
+    }
+
+    // Parks the operation on the gate, arms the deadline and watches the stop token. start holds a reference until it 
+    // returns, so a completion that comes from another thread meanwhile can't destroy the operation under it
+    void StartParked()
+    {
+        References.store(2, std::memory_order_relaxed);
+        std::stop_token token = GetStopToken();
+        if (token.stop_possible())
+            OnStop.emplace(token, StopHandler{this});
+
+        // The stop callback may have run before the operation was parked, so the token is checked once more after
+        if (!Self().Park())
+            Finish(Outcome::Opened);
+        else
+        {
+            Self().ArmDeadline();
+            if (token.stop_requested())
+                OnStopRequested();
+        }
+        Release();
+    }
+};
+#endif
+
 // This class implements a gate for a thread. It works as condition variable, 
 // but if the Open method was called in another thread before the Close method, 
 // then the Close method will not block the thread. Doesn't make sense when working in more than two threads
 class Gate
 {
-private:
-    std::mutex mtx, condVarMutex, lockMutex;
-    std::condition_variable cv;
-    bool IsActivated = true;
 public:
-    // Blocks the execution of the thread until the Open method is called. 
-    // If the Open method was called before this method, then the thread is not blocked.
-    // The Close and Open methods are synchronized with each other using a mutex
-    void Close()
+    // Counters of the paths taken by the gate operations. Opening threads and waits on several gates may update 
+    // the same counter concurrently, so each one is a relaxed atomic increment and never needs a lock
+    struct Stats
+    {
+        uint64_t FastCloses = 0;  // Close consumed an earlier Open with a single compare-and-swap
+        uint64_t SpinCloses = 0;  // Close caught Open while spinning, without entering the kernel
+        uint64_t SlowCloses = 0;  // Close found the gate closed and waited for Open
+        uint64_t FastOpens = 0;   // Open didn't make any syscall
+        uint64_t WakingOpens = 0; // Open woke the sleeping closing thread
+    };
+protected:
+    // Values of the gate word
+    static constexpr uint32_t Closed = 0;   // Nobody opened the gate and nobody sleeps on it
+    static constexpr uint32_t Opened = 1;   // The gate was opened, the next Close will pass through
+    static constexpr uint32_t Sleeping = 2; // The closing thread sleeps on the word and waits for Open
+    static constexpr uint32_t Awaited = 4;  // A continuation is registered instead of a sleeping thread, see Park
+
+    std::atomic<uint32_t> State{Closed};
+    std::atomic<uint64_t> FastCloses{0}, SpinCloses{0}, SlowCloses{0}, FastOpens{0}, WakingOpens{0};
+    AdaptiveSpin Spinner;
+    GateWaiter* Waiter = nullptr;
+
+    // Increments a counter. Several threads may count on one gate, for example two threads calling Open
+    static void Count(std::atomic<uint64_t>& counter)
+    {
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // A closing thread that finds a registered continuation is a second closer of the gate. The word never holds 
+    // Sleeping while the continuation waits, so the thread could not sleep on it and would spin
+    static void CheckSingleCloser(uint32_t state)
+    {
+        assert(state != Awaited && "the gate already has another closer");
+        if (state == Awaited)
+            throw std::logic_error("Gate::Close: the gate already has another closer");
+    }
+
+    // Consumes an earlier Open. Returns false if the gate is not opened
+    bool TryConsume()
+    {
+        uint32_t state = Opened;
+        return State.compare_exchange_strong(state, Closed, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    // Consumes an earlier Open without any syscall or lock. Returns false if the gate is not opened
+    bool TryCloseFast()
+    {
+        if (!TryConsume())
+            return false;
+
+        Count(FastCloses);
+        return true;
+    }
+
+    // Registers the continuation to run on the next Open in place of a sleeping closing thread. The continuation 
+    // must consume the Open itself with TryConsume. Returns false if the gate is already opened: then the Open 
+    // is consumed here and the continuation is not registered
+    bool Park(GateWaiter& waiter)
+    {
+        Waiter = &waiter;
+        uint32_t state = State.load(std::memory_order_relaxed);
+        while (true)
+        {
+            if (state == Opened)
+            {
+                if (State.compare_exchange_weak(state, Closed, std::memory_order_acquire, std::memory_order_relaxed))
+                    return false;
+                continue;
+            }
+
+            if (State.compare_exchange_weak(state, Awaited, std::memory_order_release, std::memory_order_relaxed))
+            {
+                Count(SlowCloses);
+                return true;
+            }
+        }
+    }
+
+    // Registers the continuation like Park, but leaves an earlier Open in the gate. Returns false if the gate is opened. 
+    // The caller must be the only closer of the gate: a gate with a sleeping Close or a registered continuation 
+    // is not touched and false is returned as well, so the node of the other closer stays in place
+    bool ParkIfClosed(GateWaiter& waiter)
+    {
+        uint32_t state = State.load(std::memory_order_relaxed);
+        assert((state == Closed || state == Opened) && "the gate already has another closer");
+        if (state != Closed)
+            return false;
+
+        // Only Open moves the gate out of Closed now, so the node is not written over the node of another closer
+        Waiter = &waiter;
+        if (!State.compare_exchange_strong(state, Awaited, std::memory_order_release, std::memory_order_relaxed))
+            return false;
+
+        Count(SlowCloses);
+        return true;
+    }
+
+    // Removes the registered continuation. Returns false if Open has already taken it to run
+    bool Unpark()
+    {
+        uint32_t state = Awaited;
+        return State.compare_exchange_strong(state, Closed, std::memory_order_relaxed, std::memory_order_relaxed);
+    }
+
+    // Runs the continuation taken from the gate word by Open
+    void ResumeWaiter()
+    {
+        Count(WakingOpens);
+        Waiter->Resume(Waiter);
+    }
+
+    // Word of a wait on several gates. The low half counts the continuations run by Open, the high half holds 
+    // the count at which the waiting thread is woken. Both are in one word, so a continuation decides about the wake 
+    // with the same atomic operation that reports its run and never reads the word of the waiting thread after it
+    static constexpr uint32_t JoinCountMask = 0xFFFF;
+    static constexpr uint32_t JoinWakeShift = 16;
+    static constexpr uint32_t JoinNoWake = JoinCountMask << JoinWakeShift;
+
+    // Node that a wait on several gates registers on each of them. The gate stays opened, the waiting thread consumes it
+    struct JoinWaiter : GateWaiter
+    {
+        std::atomic<uint32_t>* Join = nullptr;
+    };
+
+    static void OnJoinOpen(GateWaiter* waiter)
+    {
+        std::atomic<uint32_t>* join = static_cast<JoinWaiter*>(waiter)->Join;
+        uint32_t state = join->fetch_add(1, std::memory_order_acq_rel) + 1;
+        if ((state & JoinCountMask) >= (state >> JoinWakeShift))
+            Futex::Wake(*join);
+    }
+
+    // Registers the nodes on the gates in order and stops at the first opened gate. Returns the number of registered nodes
+    static size_t ParkAll(Gate* const* gates, JoinWaiter* nodes, size_t count, std::atomic<uint32_t>& join)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            nodes[i].Resume = &Gate::OnJoinOpen;
+            nodes[i].Join = &join;
+            if (!gates[i]->ParkIfClosed(nodes[i]))
+                return i;
+        }
+        return count;
+    }
+
+    // Sets the count of runs to wake at and sleeps until the continuations reach it or until the absolute 
+    // CLOCK_MONOTONIC deadline. Returns false if the deadline came first
+    static bool WaitJoin(std::atomic<uint32_t>& join, uint32_t wakeAt, const timespec* deadline = nullptr)
+    {
+        uint32_t state = join.load(std::memory_order_relaxed);
+        while (!join.compare_exchange_weak(state, (wakeAt << JoinWakeShift) | (state & JoinCountMask), std::memory_order_acquire, std::memory_order_relaxed))
+            ;
+
+        state = (wakeAt << JoinWakeShift) | (state & JoinCountMask);
+        while ((state & JoinCountMask) < wakeAt)
+        {
+            if (deadline == nullptr)
+                Futex::Wait(join, state);
+            else if (!Futex::WaitUntil(join, state, *deadline))
+                return (join.load(std::memory_order_acquire) & JoinCountMask) >= wakeAt;
+            state = join.load(std::memory_order_acquire);
+        }
+        return true;
+    }
+
+    // Removes the registered nodes and waits until the continuations that Open has already taken are done with the word, 
+    // so the nodes and the word may leave the stack
+    static void UnparkAll(Gate* const* gates, const JoinWaiter* nodes, size_t registered, std::atomic<uint32_t>& join)
+    {
+        uint32_t taken = 0;
+        for (size_t i = 0; i < registered; ++i)
+        {
+            if (nodes[i].Join != nullptr && !gates[i]->Unpark())
+                ++taken;
+        }
+        WaitJoin(join, taken);
+    }
+
+    static size_t WaitAnyOf(Gate* const* gates, JoinWaiter* nodes, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (gates[i]->TryCloseFast())
+                return i;
+        }
+
+        std::atomic<uint32_t> join{JoinNoWake};
+        size_t registered = ParkAll(gates, nodes, count, join);
+        if (registered == count)
+            WaitJoin(join, 1);
+        UnparkAll(gates, nodes, registered, join);
+
+        // Every gate whose node was run by Open is opened now, as well as the gate that stopped the registration. 
+        // Nothing is opened only if that gate had another closer
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (gates[i]->TryConsume())
+                return i;
+        }
+        throw std::logic_error("Gate::WaitAny: a gate in the set already has another closer");
+    }
+
+#if defined(SYS_futex_waitv) && defined(FUTEX_WAITV_MAX)
+    // Works as WaitAnyOf, but the thread sleeps on the words of the gates themselves with one futex_waitv call. 
+    // Each gate sees an ordinary sleeping closing thread, so Open wakes it with its usual wake syscall
+    static size_t WaitAnyOfVector(Gate* const* gates, futex_waitv* waiters, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (gates[i]->TryCloseFast())
+                return i;
+        }
+
+        size_t announced = 0;
+        for (; announced < count; ++announced)
+        {
+            uint32_t state = Closed;
+            if (!gates[announced]->State.compare_exchange_strong(state, Sleeping, std::memory_order_relaxed, std::memory_order_relaxed))
+                break;
+
+            Count(gates[announced]->SlowCloses);
+            waiters[announced].val = Sleeping;
+            waiters[announced].uaddr = reinterpret_cast<uintptr_t>(&gates[announced]->State);
+            waiters[announced].flags = FUTEX_32 | FUTEX_PRIVATE_FLAG;
+            waiters[announced].__reserved = 0;
+        }
+
+        // A gate opened during the announcement stopped it, otherwise the thread sleeps until a word leaves Sleeping
+        while (announced == count)
+        {
+            bool isOpened = false;
+            for (size_t i = 0; i < count && !isOpened; ++i)
+                isOpened = gates[i]->State.load(std::memory_order_relaxed) != Sleeping;
+            if (isOpened)
+                break;
+
+            Futex::WaitMany(waiters, static_cast<unsigned>(count));
+        }
+
+        size_t index = count;
+        for (size_t i = 0; i < count && index == count; ++i)
+        {
+            if (gates[i]->TryConsume())
+                index = i;
+        }
+
+        // The gates opened meanwhile are not in the Sleeping state, so they keep their Opens
+        for (size_t i = 0; i < announced; ++i)
+        {
+            uint32_t state = Sleeping;
+            gates[i]->State.compare_exchange_strong(state, Closed, std::memory_order_relaxed, std::memory_order_relaxed);
+        }
+
+        // Nothing is opened only if the gate that stopped the announcement had another closer
+        assert(index != count && "a gate in the set already has another closer");
+        if (index == count)
+            throw std::logic_error("Gate::WaitAny: a gate in the set already has another closer");
+        return index;
+    }
+#endif
+
+    // Registers the nodes on the gates that are not opened yet and sleeps until the last of them is opened. 
+    // On timeout the nodes are removed and nothing is consumed. futex_waitv is not used here: it would wake 
+    // the thread on every Open, while the nodes wake it only on the last one
+    static bool WaitAllOf(Gate* const* gates, JoinWaiter* nodes, size_t count, const timespec* deadline)
+    {
+        std::atomic<uint32_t> join{JoinNoWake};
+        uint32_t registered = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            nodes[i].Resume = &Gate::OnJoinOpen;
+            nodes[i].Join = &join;
+            if (gates[i]->ParkIfClosed(nodes[i]))
+                ++registered;
+            else
+                nodes[i].Join = nullptr;
+
+            // A gate left out of the set must be opened, otherwise it has another closer and its Open would be missed
+            if (nodes[i].Join == nullptr && gates[i]->State.load(std::memory_order_relaxed) != Opened)
+            {
+                UnparkAll(gates, nodes, i, join);
+                throw std::logic_error("Gate::WaitAll: a gate in the set already has another closer");
+            }
+        }
+
+        if (!WaitJoin(join, registered, deadline))
+        {
+            UnparkAll(gates, nodes, count, join);
+            return false;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+            gates[i]->TryConsume();
+        return true;
+    }
+
+    template<class... Gates>
+    static bool WaitAllUntilSteady(const timespec* deadline, Gates&... gates)
+    {
+        static_assert(sizeof...(Gates) > 0 && sizeof...(Gates) < JoinCountMask, "WaitAll takes from 1 to 65534 gates");
+        static_assert((std::is_base_of_v<Gate, Gates> && ...), "WaitAll takes gates derived from Gate");
+        Gate* list[] = {&gates...};
+        JoinWaiter nodes[sizeof...(Gates)];
+        return WaitAllOf(list, nodes, sizeof...(Gates), deadline);
+    }
+public:
+#ifdef __cpp_impl_coroutine
+    // Awaiter returned by AsyncClose. It is stored in the coroutine frame, so suspending allocates nothing
+    class CloseAwaiter : private GateWaiter
+    {
+    private:
+        friend class Gate;
+        Gate& Owner;
+        std::coroutine_handle<> Handle;
+
+        explicit CloseAwaiter(Gate& owner) : Owner(owner) {}
+
+        static void OnOpen(GateWaiter* waiter)
+        {
+            CloseAwaiter* self = static_cast<CloseAwaiter*>(waiter);
+            self->Owner.TryConsume();
+            self->Handle.resume();
+        }
+    public:
+        bool await_ready()
+        {
+            return Owner.TryCloseFast();
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            Handle = handle;
+            Resume = &CloseAwaiter::OnOpen;
+            return Owner.Park(*this);
+        }
+
+        void await_resume() {}
+    };
+
+    // Suspends the coroutine until the Open method is called, without blocking any thread: co_await gate.AsyncClose(). 
+    // If the Open method was called before, then the coroutine continues synchronously. 
+    // Otherwise the coroutine is resumed inside the Open call, on the opening thread
+    CloseAwaiter AsyncClose()
+    {
+        return CloseAwaiter(*this);
+    }
+#endif
+
+#if defined(__cpp_lib_jthread) && defined(__cpp_concepts)
+    // Operation state of the sender returned by AsyncCloseSender
+    template<class Receiver>
+    class CloseOperation : public GateOperation<CloseOperation<Receiver>, Receiver>
+    {
+    private:
+        friend class GateOperation<CloseOperation, Receiver>;
+        using Base = GateOperation<CloseOperation, Receiver>;
+        Gate& Owner;
+
+        bool Park() { return Owner.Park(*this); }
+        bool Unpark() { return Owner.Unpark(); }
+        void ArmDeadline() {}
+        void CancelDeadline() {}
+
+        void Complete(bool)
+        {
+            std::move(this->Rcvr).set_value();
+        }
+
+        static void OnOpen(GateWaiter* waiter)
+        {
+            CloseOperation* self = static_cast<CloseOperation*>(waiter);
+            self->Owner.TryConsume();
+            self->Finish(Base::Outcome::Opened);
+        }
+    public:
+        CloseOperation(Gate& owner, Receiver&& rcvr) : Base(std::move(rcvr)), Owner(owner)
+        {
+            this->Resume = &CloseOperation::OnOpen;
+        }
+
+        CloseOperation(const CloseOperation&) = delete;
+        CloseOperation& operator=(const CloseOperation&) = delete;
+
+        void start() noexcept
+        {
+            if (Owner.TryCloseFast())
+                std::move(this->Rcvr).set_value();
+            else
+                this->StartParked();
+        }
+    };
+
+    // Sender returned by AsyncCloseSender
+    class CloseSender
+    {
+    private:
+        Gate& Owner;
+    public:
+        explicit CloseSender(Gate& owner) : Owner(owner) {}
+
+        template<class Receiver>
+        CloseOperation<Receiver> connect(Receiver rcvr) const
+        {
+            return CloseOperation<Receiver>(Owner, std::move(rcvr));
+        }
+    };
+
+    // Returns a sender in the shape of std::execution that completes with set_value() when the gate is opened, 
+    // consuming the Open, or with set_stopped() when the stop token of the receiver is triggered first. 
+    // Like AsyncClose, no thread is blocked: the receiver is completed on the thread that opens the gate or stops the operation
+    CloseSender AsyncCloseSender()
+    {
+        return CloseSender(*this);
+    }
+#endif
+
+    // Blocks the execution of the thread until the Open method is called. 
+    // If the Open method was called before this method, then the thread is not blocked.
+    // The Close and Open methods are synchronized with each other using a single atomic word.
+    // Before sleeping, the thread spins for a short adaptive budget in case Open is about to be called. 
+    // Throws std::logic_error if a coroutine, sender or continuation already waits on the gate
+    void Close()
+    {
+        if (TryCloseFast())
+            return;
+
+        if (Spinner.Spin([this]() { return State.load(std::memory_order_relaxed) == Opened; }) && TryConsume())
+        {
+            Count(SpinCloses);
+            return;
+        }
+
+        Count(SlowCloses);
+        uint32_t state = State.load(std::memory_order_relaxed);
+        while (true)
+        {
+            if (state == Opened)
+            {
+                if (State.compare_exchange_weak(state, Closed, std::memory_order_acquire, std::memory_order_relaxed))
+                    return;
+                continue;
+            }
+
+            CheckSingleCloser(state);
+            if (state == Closed && !State.compare_exchange_weak(state, Sleeping, std::memory_order_relaxed, std::memory_order_relaxed))
+                continue;
+
+            Futex::Wait(State, Sleeping);
+            state = State.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Causes the thread to continue executing after the Close method. 
+    // If called before the Close method, then the Close method will not block the thread.
+    // The Close and Open methods are synchronized with each other using a single atomic word.
+    // Never waits for the closing thread: one atomic exchange and at most one wake syscall
+    void Open()
+    {
+        uint32_t state = State.exchange(Opened, std::memory_order_acq_rel);
+        if (state == Sleeping)
+        {
+            Count(WakingOpens);
+            Futex::Wake(State);
+        }
+        else if (state == Awaited)
+            ResumeWaiter();
+        else
+            Count(FastOpens);
+    }
+
+    // Sets the maximum amount of pause iterations Close spins before sleeping. Zero disables spinning
+    void SetSpinLimit(uint32_t limit)
+    {
+        Spinner.SetLimit(limit);
+    }
+
+    // Returns the counters of the paths taken by Close and Open since the gate was created
+    Stats GetStats() const
+    {
+        Stats stats;
+        stats.FastCloses = FastCloses.load(std::memory_order_relaxed);
+        stats.SpinCloses = SpinCloses.load(std::memory_order_relaxed);
+        stats.SlowCloses = SlowCloses.load(std::memory_order_relaxed);
+        stats.FastOpens = FastOpens.load(std::memory_order_relaxed);
+        stats.WakingOpens = WakingOpens.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    // Blocks the execution of the thread until any of the gates is opened and returns its index in the argument list. 
+    // Only the Open of that gate is consumed, the other opened gates stay opened. If several gates are opened 
+    // at the time, then the first of them is taken. The thread sleeps once on its own word, each gate runs 
+    // a continuation in place of the closing thread, so the calling thread is the closing thread of every gate. 
+    // On Linux 5.16 and later up to FUTEX_WAITV_MAX gates are waited on directly with the futex_waitv syscall. 
+    // No other thread or continuation may close the gates meanwhile, otherwise std::logic_error is thrown
+    template<class... Gates>
+    static size_t WaitAny(Gates&... gates)
+    {
+        static_assert(sizeof...(Gates) > 0 && sizeof...(Gates) < JoinCountMask, "WaitAny takes from 1 to 65534 gates");
+        static_assert((std::is_base_of_v<Gate, Gates> && ...), "WaitAny takes gates derived from Gate");
+        Gate* list[] = {&gates...};
+#if defined(SYS_futex_waitv) && defined(FUTEX_WAITV_MAX)
+        if constexpr (sizeof...(Gates) <= FUTEX_WAITV_MAX)
+        {
+            if (Futex::IsWaitManySupported())
+            {
+                futex_waitv waiters[sizeof...(Gates)];
+                return WaitAnyOfVector(list, waiters, sizeof...(Gates));
+            }
+        }
+#endif
+        JoinWaiter nodes[sizeof...(Gates)];
+        return WaitAnyOf(list, nodes, sizeof...(Gates));
+    }
+
+    // Blocks the execution of the thread until all the gates are opened and consumes their Opens. 
+    // The thread sleeps once: only the Open of the last gate in the set wakes it. 
+    // No other thread or continuation may close the gates meanwhile, otherwise std::logic_error is thrown
+    template<class... Gates>
+    static void WaitAll(Gates&... gates)
+    {
+        WaitAllUntilSteady(nullptr, gates...);
+    }
+
+    // Works as the WaitAll method, but stops waiting when the time is up. Returns true if all the gates were opened. 
+    // On timeout nothing is consumed: the gates opened so far stay opened
+    template<class Rep, class Period, class... Gates>
+    static bool WaitAllFor(const std::chrono::duration<Rep, Period>& duration, Gates&... gates)
+    {
+        return WaitAllUntil(std::chrono::steady_clock::now() + Futex::CeilToSteady(duration), gates...);
+    }
+
+    // Works as the WaitAll method, but stops waiting when the time has come. Returns true if all the gates were opened. 
+    // On timeout nothing is consumed: the gates opened so far stay opened
+    template<class Clock, class Duration, class... Gates>
+    static bool WaitAllUntil(const std::chrono::time_point<Clock, Duration>& timePoint, Gates&... gates)
+    {
+        timespec deadline = Futex::ToTimespec(Futex::ToSteady(timePoint).time_since_epoch());
+        return WaitAllUntilSteady(&deadline, gates...);
+    }
+};
+
+// This class implements a gate that can call a callable once it is opened, instead of blocking a thread in Close. 
+// The callable is stored inside this gate, so plain gates don't pay for the storage. Works as Gate otherwise
+class ContinuationGate : public Gate
+{
+private:
+    GateContinuation Callable;
+
+    // Node registered in place of the closing thread. Its Resume runs on the thread that opens the gate
+    struct ContinuationWaiter : GateWaiter
+    {
+        ContinuationGate* Owner = nullptr;
+    } Node;
+
+    static void RunContinuation(GateWaiter* waiter)
+    {
+        ContinuationGate* gate = static_cast<ContinuationWaiter*>(waiter)->Owner;
+        gate->TryConsume();
+        gate->Callable.Run();
+    }
+public:
+    // Calls the callable once the gate is opened, consuming the Open, instead of blocking a thread in Close. 
+    // If the Open method was called before this method, then the callable is called at once on this thread. 
+    // Otherwise it is called inside the Open call, on the opening thread. It takes the place of the closing thread, 
+    // so it can't be combined with a concurrent Close. Small callables are stored inside the gate without allocation. 
+    // One callable is pending at a time: a new one may be registered from inside the callable or after CancelOnOpen. 
+    // If a callable or a closing thread already waits, then std::logic_error is thrown and the pending callable is kept, 
+    // because a concurrent Open may be running it from the same storage
+    template<class F>
+    void OnOpen(F&& callable)
+    {
+        uint32_t state = State.load(std::memory_order_relaxed);
+        assert(state != Awaited && state != Sleeping && "the gate already has another closer");
+        if (state == Awaited || state == Sleeping)
+            throw std::logic_error("ContinuationGate::OnOpen: the gate already has another closer");
+
+        Node.Owner = this;
+        Node.Resume = &ContinuationGate::RunContinuation;
+        Callable.Set(std::forward<F>(callable));
+        if (!Park(Node))
+            Callable.Run();
+    }
+
+    // Works as the OnOpen method, but the callable is posted with executor.execute(callable) 
+    // instead of being called on the opening thread
+    template<class F, class Executor>
+    void OnOpen(F&& callable, Executor& executor)
+    {
+        OnOpen([&executor, callable = std::forward<F>(callable)]() mutable { executor.execute(std::move(callable)); });
+    }
+
+    // Removes the callable registered by the OnOpen method. Returns false if it was already called or is being called
+    bool CancelOnOpen()
+    {
+        if (Waiter != &Node || !Unpark())
+            return false;
+
+        Callable.Reset();
+        return true;
+    }
+};
+
+// This class implements a gate for a thread. It works as condition variable, 
+// but if the Open method was called in another thread before the Close method, 
+// then the Close method will not block the thread. Doesn't make sense when working in more than two threads. 
+// Supports opening and closing counter. You can call the Open method N times and then the 
+// Close method will block the execution of the thread only for N call
+class RecursiveGate
+{
+private:
+    // The gate word holds the amount of not yet consumed Open calls in the low 30 bits, a flag of the sleeping 
+    // closing thread in the high bit and a flag of the registered continuation next to it
+    static constexpr uint32_t SleepingBit = 0x80000000u;
+    static constexpr uint32_t AwaitedBit = 0x40000000u;
+    static constexpr uint32_t CountMask = AwaitedBit - 1;
+
+    std::atomic<uint32_t> State{0};
+    AdaptiveSpin Spinner;
+    GateWaiter* Waiter = nullptr;
+    uint32_t WaiterAmount = 0;
+
+    // Takes amount permits for the continuation or registers it to run on a later Open. 
+    // Returns false if the permits were taken at once: then the continuation is not registered
+    bool Park(GateWaiter& waiter, uint32_t amount)
+    {
+        Waiter = &waiter;
+        WaiterAmount = amount;
+        uint32_t state = State.load(std::memory_order_relaxed);
+        while (true)
+        {
+            if ((state & CountMask) >= amount)
+            {
+                if (State.compare_exchange_weak(state, state - amount, std::memory_order_acquire, std::memory_order_relaxed))
+                    return false;
+                continue;
+            }
+
+            if (State.compare_exchange_weak(state, state | AwaitedBit, std::memory_order_release, std::memory_order_relaxed))
+                return true;
+        }
+    }
+
+    // Removes the registered continuation. Returns false if Open has already taken it to run
+    bool Unpark()
+    {
+        return (State.fetch_and(~AwaitedBit, std::memory_order_relaxed) & AwaitedBit) != 0;
+    }
+public:
+#ifdef __cpp_impl_coroutine
+    // Awaiter returned by AsyncClose. It is stored in the coroutine frame, so suspending allocates nothing
+    class CloseAwaiter : private GateWaiter
+    {
+    private:
+        friend class RecursiveGate;
+        RecursiveGate& Owner;
+        uint32_t Amount;
+        std::coroutine_handle<> Handle;
+
+        CloseAwaiter(RecursiveGate& owner, uint32_t amount) : Owner(owner), Amount(amount) {}
+
+        // Open woke the continuation, but there may be less permits than it needs, then it waits further
+        static void OnOpen(GateWaiter* waiter)
+        {
+            CloseAwaiter* self = static_cast<CloseAwaiter*>(waiter);
+            if (!self->Owner.Park(*self, self->Amount))
+                self->Handle.resume();
+        }
+    public:
+        // Park takes the permits at once when they are available, so only the empty request is ready here. 
+        // TryClose would take a part of the permits and lose them
+        bool await_ready()
+        {
+            return Amount == 0;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            Handle = handle;
+            Resume = &CloseAwaiter::OnOpen;
+            return Owner.Park(*this, Amount);
+        }
+
+        void await_resume() {}
+    };
+
+    // Suspends the coroutine until amount permits are available and takes them, without blocking any thread: 
+    // co_await gate.AsyncClose(n). If the permits are available, then the coroutine continues synchronously. 
+    // Otherwise the coroutine is resumed inside the Open call that completes the permits, on the opening thread
+    CloseAwaiter AsyncClose(uint32_t amount = 1)
+    {
+        return CloseAwaiter(*this, amount);
+    }
+#endif
+
+#if defined(__cpp_lib_jthread) && defined(__cpp_concepts)
+    // Operation state of the sender returned by AsyncCloseSender
+    template<class Receiver>
+    class CloseOperation : public GateOperation<CloseOperation<Receiver>, Receiver>
+    {
+    private:
+        friend class GateOperation<CloseOperation, Receiver>;
+        using Base = GateOperation<CloseOperation, Receiver>;
+        RecursiveGate& Owner;
+        uint32_t Amount;
+
+        bool Park() { return Owner.Park(*this, Amount); }
+        bool Unpark() { return Owner.Unpark(); }
+        void ArmDeadline() {}
+        void CancelDeadline() {}
+
+        void Complete(bool)
+        {
+            std::move(this->Rcvr).set_value();
+        }
+
+        // Open woke the operation, but there may be less permits than it needs, then it parks again. 
+        // A stop request that came while it was unparked is picked up after parking
+        static void OnOpen(GateWaiter* waiter)
+        {
+            CloseOperation* self = static_cast<CloseOperation*>(waiter);
+            self->References.fetch_add(1, std::memory_order_relaxed);
+            if (!self->Owner.Park(*self, self->Amount))
+                self->Finish(Base::Outcome::Opened);
+            else if (self->GetStopToken().stop_requested())
+                self->OnStopRequested();
+            self->Release();
+        }
+    public:
+        CloseOperation(RecursiveGate& owner, uint32_t amount, Receiver&& rcvr) : Base(std::move(rcvr)), Owner(owner), Amount(amount)
+        {
+            this->Resume = &CloseOperation::OnOpen;
+        }
+
+        CloseOperation(const CloseOperation&) = delete;
+        CloseOperation& operator=(const CloseOperation&) = delete;
+
+        void start() noexcept
+        {
+            if (Amount == 0)
+                std::move(this->Rcvr).set_value();
+            else
+                this->StartParked();
+        }
+    };
+
+    // Sender returned by AsyncCloseSender
+    class CloseSender
+    {
+    private:
+        RecursiveGate& Owner;
+        uint32_t Amount;
+    public:
+        CloseSender(RecursiveGate& owner, uint32_t amount) : Owner(owner), Amount(amount) {}
+
+        template<class Receiver>
+        CloseOperation<Receiver> connect(Receiver rcvr) const
+        {
+            return CloseOperation<Receiver>(Owner, Amount, std::move(rcvr));
+        }
+    };
+
+    // Returns a sender in the shape of std::execution that completes with set_value() when amount permits are taken, 
+    // or with set_stopped() when the stop token of the receiver is triggered first. The permits are taken all at once, 
+    // so a stopped operation leaves all of them in the gate
+    CloseSender AsyncCloseSender(uint32_t amount = 1)
+    {
+        return CloseSender(*this, amount);
+    }
+#endif
+
+    // Blocks the execution of the thread until the Open method is called. 
+    // If the Open method was called before this method, then the thread is not blocked.
+    // The Close and Open methods are synchronized with each other using a single atomic word.
+    // Before sleeping, the thread spins for a short adaptive budget in case Open is about to be called
+    void Close()
+    {
+        Close(1);
+    }
+
+    // Blocks the execution of the thread until amount permits are available and takes all of them at once. 
+    // Permits are never taken partially, so the Open calls are consumed only when the whole batch is ready
+    void Close(uint32_t amount)
+    {
+        if (amount == 0)
+            return;
+
+        bool hasSpun = false;
+        uint32_t state = State.load(std::memory_order_relaxed);
+        while (true)
+        {
+            if ((state & CountMask) >= amount)
+            {
+                // Only one thread closes the gate, so the sleeping flag, if set, belongs to it
+                if (State.compare_exchange_weak(state, (state & CountMask) - amount, std::memory_order_acquire, std::memory_order_relaxed))
+                    return;
+                continue;
+            }
+
+            if (!hasSpun)
+            {
+                hasSpun = true;
+                Spinner.Spin([this, amount]() { return (State.load(std::memory_order_relaxed) & CountMask) >= amount; });
+                state = State.load(std::memory_order_relaxed);
+                continue;
+            }
+
+            if ((state & SleepingBit) == 0 && !State.compare_exchange_weak(state, state | SleepingBit, std::memory_order_relaxed, std::memory_order_relaxed))
+                continue;
+
+            Futex::Wait(State, state | SleepingBit);
+            state = State.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Blocks the execution of the thread until amount permits are taken or the time is up. Unlike Close(amount), 
+    // permits are taken as soon as they are available, so the method returns the amount of permits obtained before the deadline. 
+    // Sleeps with the same single futex syscall as Close, the deadline is measured by the kernel
+    template<class Rep, class Period>
+    uint32_t CloseFor(uint32_t amount, const std::chrono::duration<Rep, Period>& duration)
+    {
+        return CloseUntil(amount, std::chrono::steady_clock::now() + Futex::CeilToSteady(duration));
+    }
+
+    // Works as CloseFor, but waits until the time point of any clock. Other clocks than steady_clock are converted once
+    template<class Clock, class Duration>
+    uint32_t CloseUntil(uint32_t amount, const std::chrono::time_point<Clock, Duration>& timePoint)
+    {
+        uint32_t taken = TryClose(amount);
+        if (taken == amount)
+            return taken;
+
+        timespec timeout = Futex::ToTimespec(Futex::ToSteady(timePoint).time_since_epoch());
+        bool isTimedOut = false;
+        uint32_t state = State.load(std::memory_order_relaxed);
+        while (true)
+        {
+            uint32_t available = state & CountMask;
+            if (available != 0)
+            {
+                uint32_t portion = std::min(available, amount - taken);
+                if (State.compare_exchange_weak(state, available - portion, std::memory_order_acquire, std::memory_order_relaxed))
+                {
+                    taken += portion;
+                    if (taken == amount)
+                        return taken;
+                    state = available - portion;
+                }
+                continue;
+            }
+
+            if (isTimedOut)
+            {
+                // Withdraw the sleeping flag, so the following Open calls don't issue useless wake syscalls
+                if ((state & SleepingBit) == 0 || State.compare_exchange_weak(state, 0, std::memory_order_relaxed, std::memory_order_relaxed))
+                    return taken;
+                continue;
+            }
+
+            if ((state & SleepingBit) == 0 && !State.compare_exchange_weak(state, SleepingBit, std::memory_order_relaxed, std::memory_order_relaxed))
+                continue;
+
+            isTimedOut = !Futex::WaitUntil(State, SleepingBit, timeout);
+            state = State.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Takes one permit if it is available and never blocks the thread. Returns the amount of taken permits: 0 or 1
+    uint32_t TryClose()
+    {
+        return TryClose(1);
+    }
+
+    // Takes up to amount permits, as many as are available, and never blocks the thread. 
+    // Returns the amount of taken permits
+    uint32_t TryClose(uint32_t amount)
+    {
+        uint32_t state = State.load(std::memory_order_relaxed);
+        while (true)
+        {
+            uint32_t taken = std::min(state & CountMask, amount);
+            if (taken == 0)
+                return 0;
+
+            if (State.compare_exchange_weak(state, state - taken, std::memory_order_acquire, std::memory_order_relaxed))
+                return taken;
+        }
+    }
+
+    // Causes the thread to continue executing after the Close method. 
+    // If called before the Close method, then the Close method will not block the thread.
+    // The Close and Open methods are synchronized with each other using a single atomic word.
+    // Never waits for the closing thread: at most two atomic operations and one wake syscall
+    void Open()
+    {
+        Open(1);
+    }
+
+    // Works as amount calls of the Open method, but adds all permits with a single atomic increment 
+    // and wakes the closing thread at most once. The total amount of not consumed permits must stay below 2^30
+    void Open(uint32_t amount)
+    {
+        if (amount == 0)
+            return;
+
+        uint32_t state = State.fetch_add(amount, std::memory_order_acq_rel);
+        if ((state & SleepingBit) != 0)
+        {
+            // The closing thread re-checks the counter after every wakeup, so clearing the flag here can't lose it
+            State.fetch_and(~SleepingBit, std::memory_order_relaxed);
+            Futex::Wake(State);
+        }
+        else if ((state & AwaitedBit) != 0 && ((state + amount) & CountMask) >= WaiterAmount && 
+            (State.fetch_and(~AwaitedBit, std::memory_order_acquire) & AwaitedBit) != 0)
+        {
+            // WaiterAmount was written before the flag was set, so reading it after seeing the flag is safe. 
+            // While the permits fall short the continuation stays registered for a later Open
+            Waiter->Resume(Waiter);
+        }
+    }
+
+    // Sets the maximum amount of pause iterations Close spins before sleeping. Zero disables spinning
+    void SetSpinLimit(uint32_t limit)
+    {
+        Spinner.SetLimit(limit);
+    }
+};
+
+// This class implements a hierarchical timer wheel driven by one thread. Thousands of deadlines share this thread 
+// instead of arming a kernel timer each. Arming and cancelling a timer are O(1), deadlines are rounded up 
+// to the wheel tick, so deadlines that fall into the same tick fire with a single wakeup of the driving thread
+class TimerWheel
+{
+public:
+    // Intrusive timer node. Lives as long as its owner, usually on the stack of a waiting thread. 
+    // The callback runs on the driving thread without the wheel locked, so it may arm and cancel timers, but must be short
+    struct Timer
+    {
+        void (*Callback)(Timer*) = nullptr;
+    private:
+        friend class TimerWheel;
+        Timer* Prev = nullptr;
+        Timer* Next = nullptr;
+        Timer** Head = nullptr;
+        uint64_t Expiry = 0;
+        bool IsArmed = false;
+    };
+private:
+    // 4 levels of 64 slots cover 2^24 ticks, about 4.6 hours with the default tick. 
+    // Later deadlines are parked in the last level and re-sorted when it cascades
+    static constexpr unsigned LevelBits = 6;
+    static constexpr unsigned LevelCount = 4;
+    static constexpr uint64_t SlotMask = (uint64_t(1) << LevelBits) - 1;
+    static constexpr uint64_t MaxDelta = (uint64_t(1) << (LevelBits * LevelCount)) - 1;
+    static constexpr uint64_t NoTick = UINT64_MAX;
+
+    std::mutex WheelMutex;
+    Timer* Slots[LevelCount][SlotMask + 1] = {};
+    std::chrono::steady_clock::time_point Start;
+    std::chrono::nanoseconds TickLength;
+    uint64_t CurrentTick = 0;       // The next tick to process
+    uint64_t SleepUntilTick = NoTick; // The tick the driving thread sleeps until
+    size_t ArmedCount = 0;
+    bool IsStopping = false;
+    Timer* Firing = nullptr;        // Expired timers whose callbacks have not run yet
+    Timer* Running = nullptr;       // The timer whose callback is running now
+    size_t CancelWaiters = 0;
+    std::atomic<uint32_t> RunningDone{0};
+    std::atomic<uint32_t> Wakeup{0};
+    std::thread Driver;
+
+    // Returns the number of whole ticks between the start of the wheel and the time point
+    uint64_t TickOf(std::chrono::steady_clock::time_point timePoint) const
+    {
+        if (timePoint <= Start)
+            return 0;
+        return static_cast<uint64_t>((timePoint - Start) / TickLength);
+    }
+
+    void Link(Timer& timer)
+    {
+        uint64_t delta = std::min(timer.Expiry > CurrentTick ? timer.Expiry - CurrentTick : 0, MaxDelta);
+        uint64_t expiry = CurrentTick + delta;
+
+        unsigned level = 0;
+        while (level + 1 < LevelCount && delta >= (uint64_t(1) << (LevelBits * (level + 1))))
+            ++level;
+
+        Timer*& head = Slots[level][(expiry >> (LevelBits * level)) & SlotMask];
+        timer.Head = &head;
+        timer.Prev = nullptr;
+        timer.Next = head;
+        if (head != nullptr)
+            head->Prev = &timer;
+        head = &timer;
+    }
+
+    void Unlink(Timer& timer)
+    {
+        if (timer.Prev != nullptr)
+            timer.Prev->Next = timer.Next;
+        else
+            *timer.Head = timer.Next;
+
+        if (timer.Next != nullptr)
+            timer.Next->Prev = timer.Prev;
+    }
+
+    // Moves the timers of the current tick to the firing list. When the lowest level wraps around, 
+    // the matching slots of the upper levels are first moved down closer to their deadlines
+    void ProcessTick()
+    {
+        uint64_t tick = CurrentTick;
+        for (unsigned level = 1; level < LevelCount && ((tick >> (LevelBits * (level - 1))) & SlotMask) == 0; ++level)
+        {
+            Timer* timer = Slots[level][(tick >> (LevelBits * level)) & SlotMask];
+            Slots[level][(tick >> (LevelBits * level)) & SlotMask] = nullptr;
+            while (timer != nullptr)
+            {
+                Timer* next = timer->Next;
+                Link(*timer);
+                timer = next;
+            }
+        }
+
+        Timer* timer = Slots[0][tick & SlotMask];
+        Slots[0][tick & SlotMask] = nullptr;
+        ++CurrentTick;
+        while (timer != nullptr)
+        {
+            Timer* next = timer->Next;
+            timer->Head = &Firing;
+            timer->Prev = nullptr;
+            timer->Next = Firing;
+            if (Firing != nullptr)
+                Firing->Prev = timer;
+            Firing = timer;
+            timer = next;
+        }
+    }
+
+    // Runs the callbacks of the expired timers one by one with the wheel unlocked. 
+    // The timer is not touched after its callback, so the callback may release it
+    void FireExpired(std::unique_lock<std::mutex>& lk)
+    {
+        while (Firing != nullptr)
+        {
+            Timer* timer = Firing;
+            Unlink(*timer);
+            timer->IsArmed = false;
+            --ArmedCount;
+            Running = timer;
+            lk.unlock();
+
+            timer->Callback(timer);
+
+            lk.lock();
+            Running = nullptr;
+            if (CancelWaiters != 0)
+            {
+                RunningDone.fetch_add(1, std::memory_order_relaxed);
+                Futex::Wake(RunningDone, INT_MAX);
+            }
+        }
+    }
+
+    // Returns the next tick that has timers to fire or upper level slots to cascade
+    uint64_t NextEventTick() const
+    {
+        if (ArmedCount == 0)
+            return NoTick;
+
+        for (uint64_t tick = CurrentTick; ; ++tick)
+        {
+            if ((tick & SlotMask) == 0 || Slots[0][tick & SlotMask] != nullptr)
+                return tick;
+        }
+    }
+
+    void Run()
+    {
+        std::unique_lock<std::mutex> lk(WheelMutex);
+        while (!IsStopping)
+        {
+            uint64_t nowTick = TickOf(std::chrono::steady_clock::now());
+            while (ArmedCount != 0 && CurrentTick <= nowTick)
+                ProcessTick();
+            FireExpired(lk);
+
+            SleepUntilTick = NextEventTick();
+            uint64_t sleepUntilTick = SleepUntilTick;
+            uint32_t wakeup = Wakeup.load(std::memory_order_relaxed);
+            lk.unlock();
+
+            if (sleepUntilTick == NoTick)
+                Futex::Wait(Wakeup, wakeup);
+            else
+                Futex::WaitUntil(Wakeup, wakeup, Futex::ToTimespec((Start + TickLength * sleepUntilTick).time_since_epoch()));
+
+            lk.lock();
+        }
+    }
+public:
+    // Starts the driving thread. Deadlines are rounded up to a whole tick. 
+    // The tick must be positive, otherwise std::invalid_argument is thrown and no thread is started
+    explicit TimerWheel(std::chrono::nanoseconds tickLength = std::chrono::milliseconds(1)) 
+        : Start(std::chrono::steady_clock::now()), TickLength(tickLength)
+    {
+        if (TickLength <= std::chrono::nanoseconds::zero())
+            throw std::invalid_argument("TimerWheel: the tick length must be positive");
+        Driver = std::thread(&TimerWheel::Run, this);
+    }
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // Stops the driving thread. Timers that are still armed will never fire
+    ~TimerWheel()
+    {
+        {
+            std::lock_guard<std::mutex> lk(WheelMutex);
+            IsStopping = true;
+            Wakeup.fetch_add(1, std::memory_order_relaxed);
+        }
+        Futex::Wake(Wakeup);
+        Driver.join();
+    }
+
+    // Arms the timer to fire at the deadline or up to one tick later. Re-arms the timer if it is already armed
+    void Arm(Timer& timer, std::chrono::steady_clock::time_point deadline)
+    {
+        bool isEarlier;
+        {
+            std::lock_guard<std::mutex> lk(WheelMutex);
+            if (timer.IsArmed)
+                Unlink(timer);
+            else
+                ++ArmedCount;
+
+            // An empty wheel skips the idle ticks at once instead of processing them one by one
+            if (ArmedCount == 1)
+                CurrentTick = std::max(CurrentTick, TickOf(std::chrono::steady_clock::now()));
+
+            uint64_t ticks = deadline <= Start ? 0 : static_cast<uint64_t>(((deadline - Start) + TickLength - std::chrono::nanoseconds(1)) / TickLength);
+            timer.Expiry = ticks;
+            timer.IsArmed = true;
+            Link(timer);
+
+            isEarlier = ticks < SleepUntilTick;
+            if (isEarlier)
+            {
+                SleepUntilTick = ticks;
+                Wakeup.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        if (isEarlier)
+            Futex::Wake(Wakeup);
+    }
+
+    // Disarms the timer. Returns false if the timer has already fired or was not armed. 
+    // After the return the callback of the timer is not running and will not run, 
+    // unless it is called from that callback itself
+    bool Cancel(Timer& timer)
+    {
+        std::unique_lock<std::mutex> lk(WheelMutex);
+        if (timer.IsArmed)
+        {
+            Unlink(timer);
+            timer.IsArmed = false;
+            --ArmedCount;
+            return true;
+        }
+
+        if (Running == &timer && std::this_thread::get_id() != Driver.get_id())
+        {
+            ++CancelWaiters;
+            while (Running == &timer)
+            {
+                uint32_t runningDone = RunningDone.load(std::memory_order_relaxed);
+                lk.unlock();
+                Futex::Wait(RunningDone, runningDone);
+                lk.lock();
+            }
+            --CancelWaiters;
+        }
+        return false;
+    }
+};
+
+// This class implements a gate for a thread. It works as condition variable, 
+// but if the Open method was called in another thread before the Close method, 
+// then the Close method will not block the thread. Doesn't make sense when working in more than two threads
+class TimeGate : public Gate
+{
+private:
+    // Value of the gate word set by a timer wheel when the deadline of the sleeping thread has come
+    static constexpr uint32_t TimedOut = 3;
+
+    std::atomic<int64_t> SlackNs{0};
+
+    // Moves the deadline up to the next multiple of the slack on the monotonic clock. Deadlines of all gates 
+    // with the same slack that fall into one window then expire at the same instant and share one timer interrupt
+    std::chrono::steady_clock::time_point ApplySlack(std::chrono::steady_clock::time_point deadline) const
+    {
+        int64_t slack = SlackNs.load(std::memory_order_relaxed);
+        if (slack <= 1)
+            return deadline;
+
+        int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+        int64_t rounded = (ns / slack + (ns % slack > 0 ? 1 : 0)) * slack;
+        return deadline + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(rounded - ns));
+    }
+
+    // Timer wheel node that wakes the closing thread of its gate
+    struct WheelTimer : TimerWheel::Timer
+    {
+        TimeGate* Owner = nullptr;
+    };
+
+    static void OnWheelTimer(TimerWheel::Timer* timer)
+    {
+        TimeGate* gate = static_cast<WheelTimer*>(timer)->Owner;
+        uint32_t state = Sleeping;
+        if (gate->State.compare_exchange_strong(state, TimedOut, std::memory_order_relaxed, std::memory_order_relaxed))
+            Futex::Wake(gate->State);
+    }
+
+    // Blocks the thread until the gate is opened or the timer wheel reports the deadline. Returns true if the gate was opened.
+    // The thread sleeps without a kernel timeout, the wheel wakes it through the TimedOut state
+    bool WaitWithWheel(TimerWheel& wheel, std::chrono::steady_clock::time_point deadline)
+    {
+        Count(SlowCloses);
+        uint32_t state = State.load(std::memory_order_relaxed);
+        while (state != Sleeping)
+        {
+            if (state == Opened)
+            {
+                if (State.compare_exchange_weak(state, Closed, std::memory_order_acquire, std::memory_order_relaxed))
+                    return true;
+                continue;
+            }
+
+            // Taking the word over from a registered continuation would lose it, so this is checked before the timer is armed
+            CheckSingleCloser(state);
+            if (State.compare_exchange_weak(state, Sleeping, std::memory_order_relaxed, std::memory_order_relaxed))
+                state = Sleeping;
+        }
+
+        // The thread announced itself before arming, so the timer can't fire into a gate nobody sleeps on
+        WheelTimer timer;
+        timer.Callback = &TimeGate::OnWheelTimer;
+        timer.Owner = this;
+        wheel.Arm(timer, ApplySlack(deadline));
+
+        while (true)
+        {
+            if (state == Sleeping)
+            {
+                Futex::Wait(State, Sleeping);
+                state = State.load(std::memory_order_relaxed);
+                continue;
+            }
+
+            // Either the gate was opened or the deadline has come. Open may overwrite TimedOut, then the gate counts as opened
+            bool isOpened = state == Opened;
+            if (State.compare_exchange_weak(state, Closed, isOpened ? std::memory_order_acquire : std::memory_order_relaxed, std::memory_order_relaxed))
+            {
+                wheel.Cancel(timer);
+                return isOpened;
+            }
+        }
+    }
+
+    // Blocks the thread until the gate is opened or the deadline is reached. Returns true if the gate was opened.
+    // The deadline is passed to the kernel as an absolute CLOCK_MONOTONIC time, so the clock is never read here.
+    // On timeout the closing thread withdraws from the word, so the gate remains active
+    bool WaitUntil(std::chrono::steady_clock::time_point deadline)
+    {
+        Count(SlowCloses);
+        timespec timeout = Futex::ToTimespec(ApplySlack(deadline).time_since_epoch());
+        bool isTimedOut = false;
+        uint32_t state = State.load(std::memory_order_relaxed);
+        while (true)
+        {
+            if (state == Opened)
+            {
+                if (State.compare_exchange_weak(state, Closed, std::memory_order_acquire, std::memory_order_relaxed))
+                    return true;
+                continue;
+            }
+
+            CheckSingleCloser(state);
+            if (state == Closed && !State.compare_exchange_weak(state, Sleeping, std::memory_order_relaxed, std::memory_order_relaxed))
+                continue;
+
+            if (isTimedOut)
+            {
+                // If Open slipped in before the withdrawal, then the state is Opened and will be consumed above
+                if (State.compare_exchange_strong(state, Closed, std::memory_order_relaxed, std::memory_order_relaxed))
+                    return false;
+                continue;
+            }
+
+            isTimedOut = !Futex::WaitUntil(State, Sleeping, timeout);
+            state = State.load(std::memory_order_relaxed);
+        }
+    }
+public:
+    // Blocks the execution of the thread until the Open method is called or time's not up.
+    // If the Open method was called before this method, then the thread is not blocked.
+    // The Close and Open methods are synchronized with each other using a single atomic word.
+    // After the time expires, the gate remains active, which means that the following Close method will block the thread.
+    // Accepts a duration of any precision. Returns true if the gate was opened and false if the time is up
+    template<class Rep, class Period>
+    bool CloseFor(const std::chrono::duration<Rep, Period>& duration)
+    {
+        if (TryCloseFast())
+            return true;
+
+        return WaitUntil(std::chrono::steady_clock::now() + Futex::CeilToSteady(duration));
+    }
+
+    // Blocks the execution of the thread until the Open method is called or the time has come for.
+    // If the Open method was called before this method, then the thread is not blocked.
+    // The Close and Open methods are synchronized with each other using a single atomic word.
+    // After the time expires, the gate remains active, which means that the following Close method will block the thread.
+    // Accepts a time point of any clock and precision. Returns true if the gate was opened and false if the time has come.
+    // Steady clock time points are waited on natively, other clocks are converted to the monotonic clock once, 
+    // so steps of the wall clock during the wait neither shorten nor extend it
+    template<class Clock, class Duration>
+    bool CloseUntil(const std::chrono::time_point<Clock, Duration>& timePoint)
+    {
+        if (TryCloseFast())
+            return true;
+
+        return WaitUntil(Futex::ToSteady(timePoint));
+    }
+
+    // Works as the CloseFor method, but the deadline is tracked by the timer wheel instead of a kernel timer of the thread. 
+    // The deadline is rounded up to the tick of the wheel
+    template<class Rep, class Period>
+    bool CloseFor(const std::chrono::duration<Rep, Period>& duration, TimerWheel& wheel)
+    {
+        if (TryCloseFast())
+            return true;
+
+        return WaitWithWheel(wheel, std::chrono::steady_clock::now() + Futex::CeilToSteady(duration));
+    }
+
+    // Works as the CloseUntil method, but the deadline is tracked by the timer wheel instead of a kernel timer of the thread. 
+    // The deadline is rounded up to the tick of the wheel
+    template<class Clock, class Duration>
+    bool CloseUntil(const std::chrono::time_point<Clock, Duration>& timePoint, TimerWheel& wheel)
+    {
+        if (TryCloseFast())
+            return true;
+
+        return WaitWithWheel(wheel, Futex::ToSteady(timePoint));
+    }
+
+#if defined(__cpp_lib_jthread) && defined(__cpp_concepts)
+    // Operation state of the senders returned by AsyncCloseForSender and AsyncCloseUntilSender
+    template<class Receiver>
+    class TimedCloseOperation : public GateOperation<TimedCloseOperation<Receiver>, Receiver>
+    {
+    private:
+        friend class GateOperation<TimedCloseOperation, Receiver>;
+        using Base = GateOperation<TimedCloseOperation, Receiver>;
+
+        struct DeadlineTimer : TimerWheel::Timer
+        {
+            TimedCloseOperation* Operation = nullptr;
+        };
+
+        TimeGate& Owner;
+        TimerWheel& Wheel;
+        std::chrono::steady_clock::time_point Deadline;
+        DeadlineTimer Timer;
+
+        bool Park() { return Owner.Park(*this); }
+        bool Unpark() { return Owner.Unpark(); }
+
+        // The timer is armed only after the operation is parked, so it can't fire into a gate nobody waits on
+        void ArmDeadline()
+        {
+            Timer.Callback = &TimedCloseOperation::OnTimer;
+            Timer.Operation = this;
+            Wheel.Arm(Timer, Owner.ApplySlack(Deadline));
+        }
+
+        void CancelDeadline()
+        {
+            Wheel.Cancel(Timer);
+        }
+
+        void Complete(bool isOpened)
+        {
+            std::move(this->Rcvr).set_value(isOpened);
+        }
+
+        static void OnTimer(TimerWheel::Timer* timer)
+        {
+            static_cast<DeadlineTimer*>(timer)->Operation->OnDeadline();
+        }
+
+        static void OnOpen(GateWaiter* waiter)
+        {
+            TimedCloseOperation* self = static_cast<TimedCloseOperation*>(waiter);
+            self->Owner.TryConsume();
+            self->Finish(Base::Outcome::Opened);
+        }
+    public:
+        TimedCloseOperation(TimeGate& owner, TimerWheel& wheel, std::chrono::steady_clock::time_point deadline, Receiver&& rcvr) 
+            : Base(std::move(rcvr)), Owner(owner), Wheel(wheel), Deadline(deadline)
+        {
+            this->Resume = &TimedCloseOperation::OnOpen;
+        }
+
+        TimedCloseOperation(const TimedCloseOperation&) = delete;
+        TimedCloseOperation& operator=(const TimedCloseOperation&) = delete;
+
+        void start() noexcept
+        {
+            if (Owner.TryCloseFast())
+                std::move(this->Rcvr).set_value(true);
+            else
+                this->StartParked();
+        }
+    };
+
+    // Sender returned by AsyncCloseForSender and AsyncCloseUntilSender
+    class TimedCloseSender
+    {
+    private:
+        TimeGate& Owner;
+        TimerWheel& Wheel;
+        std::chrono::steady_clock::time_point Deadline;
+    public:
+        TimedCloseSender(TimeGate& owner, TimerWheel& wheel, std::chrono::steady_clock::time_point deadline) 
+            : Owner(owner), Wheel(wheel), Deadline(deadline) {}
+
+        template<class Receiver>
+        TimedCloseOperation<Receiver> connect(Receiver rcvr) const
+        {
+            return TimedCloseOperation<Receiver>(Owner, Wheel, Deadline, std::move(rcvr));
+        }
+    };
+
+    // Returns a sender that completes with set_value(true) when the gate is opened, with set_value(false) when the time 
+    // is up and with set_stopped() when the stop token of the receiver is triggered first. The deadline is tracked 
+    // by the timer wheel, so no thread sleeps for it: on timeout the receiver is completed on the driving thread of the wheel. 
+    // The deadline is counted from the call of this method
+    template<class Rep, class Period>
+    TimedCloseSender AsyncCloseForSender(const std::chrono::duration<Rep, Period>& duration, TimerWheel& wheel)
+    {
+        return TimedCloseSender(*this, wheel, std::chrono::steady_clock::now() + Futex::CeilToSteady(duration));
+    }
+
+    // Works as the AsyncCloseForSender method, but accepts a time point of any clock
+    template<class Clock, class Duration>
+    TimedCloseSender AsyncCloseUntilSender(const std::chrono::time_point<Clock, Duration>& timePoint, TimerWheel& wheel)
+    {
+        return TimedCloseSender(*this, wheel, Futex::ToSteady(timePoint));
+    }
+#endif
+
+    // Sets how late the deadlines of this gate may expire. Deadlines are rounded up to a multiple of the slack, 
+    // so soft deadlines of many gates are grouped into one wakeup per window. Zero keeps the deadlines precise
+    template<class Rep, class Period>
+    void SetSlack(const std::chrono::duration<Rep, Period>& slack)
+    {
+        SlackNs.store(std::chrono::duration_cast<std::chrono::nanoseconds>(slack).count(), std::memory_order_relaxed);
+    }
+
+    // Causes the thread to continue executing after the CloseFor method. If the time is over before this method is called, then it will not do anything
+    // If called before the Close method, then the Close method will block the thread.
+    // The Close and Open methods are synchronized with each other using a single atomic word.
+    // Never waits for the closing thread: one atomic operation and at most one wake syscall
+    void OpenIfClosed()
+    {
+        uint32_t state = State.load(std::memory_order_relaxed);
+        if ((state != Sleeping && state != Awaited) || !State.compare_exchange_strong(state, Opened, std::memory_order_acq_rel, std::memory_order_relaxed))
+            return;
+
+        if (state == Awaited)
+            ResumeWaiter();
+        else
+        {
+            Count(WakingOpens);
+            Futex::Wake(State);
+        }
+    }
+};
+
+// This class implements a periodic time gate. The CloseTick method wakes the thread on absolute tick boundaries, 
+// so the time spent between the calls doesn't shift the schedule, and reports the ticks that were missed. 
+// The Open method cuts the current period short. Doesn't make sense when working in more than two threads
+class TickerGate : public TimeGate
+{
+private:
+    std::chrono::steady_clock::duration TickPeriod;
+    std::chrono::steady_clock::time_point NextTick;
+
+    // Rounds the period up to the steady_clock precision. A period that is not positive would make CloseTick divide by zero
+    template<class Rep, class Period>
+    static std::chrono::steady_clock::duration CheckedPeriod(const std::chrono::duration<Rep, Period>& period)
+    {
+        if (!(period > period.zero()))
+            throw std::invalid_argument("TickerGate: the period must be positive");
+        return Futex::CeilToSteady(period);
+    }
+public:
+    // Result of waiting for a tick
+    struct Tick
+    {
+        bool IsOpened = false;    // The Open method cut the period short, the tick boundary is still ahead
+        uint64_t MissedTicks = 0; // Tick boundaries that passed while the thread was busy, not counting the one it woke on
+    };
+
+    // Starts the schedule: the first tick comes one period from now. 
+    // The period must be positive, otherwise std::invalid_argument is thrown
+    template<class Rep, class Period>
+    explicit TickerGate(const std::chrono::duration<Rep, Period>& period) 
+        : TickPeriod(CheckedPeriod(period)), NextTick(std::chrono::steady_clock::now() + TickPeriod) {}
+
+    // Changes the period and restarts the schedule from now. 
+    // The period must be positive, otherwise std::invalid_argument is thrown and the schedule is kept
+    template<class Rep, class Period>
+    void SetPeriod(const std::chrono::duration<Rep, Period>& period)
+    {
+        TickPeriod = CheckedPeriod(period);
+        NextTick = std::chrono::steady_clock::now() + TickPeriod;
+    }
+
+    // Blocks the execution of the thread until the next tick boundary or until the Open method is called. 
+    // Opening doesn't move the schedule, so the next call waits for the same boundary. 
+    // If the boundary has already passed, then the method returns immediately and reports the boundaries missed after it
+    Tick CloseTick()
+    {
+        Tick tick;
+        if (CloseUntil(NextTick))
+        {
+            tick.IsOpened = true;
+            return tick;
+        }
+
+        auto late = std::chrono::steady_clock::now() - NextTick;
+        tick.MissedTicks = late > late.zero() ? static_cast<uint64_t>(late / TickPeriod) : 0;
+        NextTick += TickPeriod * (tick.MissedTicks + 1);
+        return tick;
+    }
+};
+
+// This class implements a gate for any number of threads. Every Close call waits in a FIFO queue 
+// and every Open call releases exactly one waiting thread, the one that came first. 
+// Open calls made while nobody waits are remembered, so each of them lets one later Close pass without blocking. 
+// Queue nodes live on the stacks of the waiting threads, so nothing is allocated per wait
+class MultiGate
+{
+private:
+    // Node of the intrusive waiter queue. Each waiter sleeps on its own word, so Open wakes exactly one thread
+    struct Waiter
+    {
+        std::atomic<uint32_t> IsReleased{0};
+        Waiter* Next = nullptr;
+    };
+
+    std::mutex QueueMutex;
+    Waiter* Head = nullptr;
+    Waiter* Tail = nullptr;
+    uint32_t PendingOpens = 0;
+public:
+    // Blocks the execution of the thread until an Open call releases it. Threads are released in the order they called Close.
+    // If there are not consumed Open calls, then the thread is not blocked
+    void Close()
+    {
+        Waiter waiter;
+        {
+            std::lock_guard<std::mutex> lk(QueueMutex);
+            if (PendingOpens != 0)
+            {
+                --PendingOpens;
+                return;
+            }
+
+            if (Tail != nullptr)
+                Tail->Next = &waiter;
+            else
+                Head = &waiter;
+            Tail = &waiter;
+        }
+
+        while (waiter.IsReleased.load(std::memory_order_acquire) == 0)
+            Futex::Wait(waiter.IsReleased, 0);
+    }
+
+    // Releases the thread that has been waiting in Close the longest. 
+    // If no thread is waiting, then the next Close call will not block the thread
+    void Open()
+    {
+        Waiter* waiter;
+        {
+            std::lock_guard<std::mutex> lk(QueueMutex);
+            waiter = Head;
+            if (waiter == nullptr)
+            {
+                ++PendingOpens;
+                return;
+            }
+
+            Head = waiter->Next;
+            if (Head == nullptr)
+                Tail = nullptr;
+        }
+
+        // The waiter may return and reuse its stack as soon as the flag is set. 
+        // The wake syscall only uses the address, so at worst it causes a spurious wakeup that every wait tolerates
+        waiter->IsReleased.store(1, std::memory_order_release);
+        Futex::Wake(waiter->IsReleased);
+    }
+};
+
+// This class implements a gate with manual reset for any number of threads. Open releases every waiting thread 
+// with a single wake syscall and leaves the gate opened, so all following Close calls pass through until Reset is called
+class BroadcastGate
+{
+private:
+    // The gate word holds the opened flag, the flag of sleeping threads and the number of Open calls in the other bits. 
+    // A waiter that sees the number change knows it was released, even if Reset closed the gate before it woke up
+    static constexpr uint32_t OpenedBit = 1;
+    static constexpr uint32_t SleepingBit = 2;
+    static constexpr uint32_t GenerationStep = 4;
+    static constexpr uint32_t GenerationMask = ~(OpenedBit | SleepingBit);
+
+    std::atomic<uint32_t> State{0};
+public:
+    // Blocks the execution of the thread until the Open method is called. 
+    // If the gate is opened, then the method is a single atomic load
+    void Close()
+    {
+        uint32_t state = State.load(std::memory_order_acquire);
+        if ((state & OpenedBit) != 0)
+            return;
+
+        uint32_t generation = state & GenerationMask;
+        while (true)
+        {
+            if ((state & OpenedBit) != 0 || (state & GenerationMask) != generation)
+                return;
+
+            if ((state & SleepingBit) == 0 && !State.compare_exchange_weak(state, state | SleepingBit, std::memory_order_acquire, std::memory_order_acquire))
+                continue;
+
+            Futex::Wait(State, state | SleepingBit);
+            state = State.load(std::memory_order_acquire);
+        }
+    }
+
+    // Opens the gate and releases all waiting threads with a single wake syscall. 
+    // The gate remains opened until the Reset method is called
+    void Open()
+    {
+        uint32_t state = State.load(std::memory_order_relaxed);
+        do
+        {
+            if ((state & OpenedBit) != 0)
+                return;
+        } while (!State.compare_exchange_weak(state, ((state & GenerationMask) + GenerationStep) | OpenedBit, std::memory_order_release, std::memory_order_relaxed));
+
+        if ((state & SleepingBit) != 0)
+            Futex::Wake(State, INT_MAX);
+    }
+
+    // Closes the gate, so the following Close calls will block the threads until the next Open call. 
+    // Threads released by the previous Open are not affected
+    void Reset()
+    {
+        State.fetch_and(~OpenedBit, std::memory_order_relaxed);
+    }
+
+    // Returns true if the gate is opened
+    bool IsOpened() const
+    {
+        return (State.load(std::memory_order_acquire) & OpenedBit) != 0;
+    }
+};
+
+#ifdef __linux__
+// Owner of a file descriptor. Closes the descriptor on destruction
+class FileDescriptor
+{
+private:
+    int Fd = -1;
+public:
+    FileDescriptor() = default;
+
+    // Takes ownership of the descriptor. Throws std::system_error with the current errno if the descriptor is invalid
+    FileDescriptor(int fd, const char* what) : Fd(fd)
+    {
+        if (Fd < 0)
+            throw std::system_error(errno, std::system_category(), what);
+    }
+
+    FileDescriptor(FileDescriptor&& other) noexcept : Fd(other.Fd)
+    {
+        other.Fd = -1;
+    }
+
+    FileDescriptor& operator=(FileDescriptor&& other) noexcept
+    {
+        std::swap(Fd, other.Fd);
+        return *this;
+    }
+
+    ~FileDescriptor()
+    {
+        if (Fd >= 0)
+            close(Fd);
+    }
+
+    int Get() const
+    {
+        return Fd;
+    }
+};
+
+// This class implements a time gate for threads that sit in an event loop. Instead of blocking the thread it exposes 
+// a file descriptor that becomes readable when the gate is opened or the deadline passes, so the gate can be added to epoll 
+// next to sockets. Inside it is an eventfd for Open and a timerfd for the deadline, joined by an epoll descriptor. 
+// Doesn't make sense when working in more than two threads
+class PollTimeGate
+{
+private:
+    FileDescriptor EventFd, TimerFd, EpollFd;
+
+    void SetTimer(const itimerspec& spec)
+    {
+        if (timerfd_settime(TimerFd.Get(), TFD_TIMER_ABSTIME, &spec, nullptr) != 0)
+            throw std::system_error(errno, std::system_category(), "timerfd_settime");
+    }
+
+    // Reads the descriptor and returns true if it had something to read
+    static bool Drain(const FileDescriptor& fd)
+    {
+        uint64_t value;
+        return read(fd.Get(), &value, sizeof(value)) == sizeof(value);
+    }
+public:
+    // Result of waiting on the gate
+    enum class Result
+    {
+        None,    // Nothing happened yet
+        Opened,  // The Open method was called
+        TimedOut // The deadline passed
+    };
+
+    // Creates the descriptors. Throws std::system_error if the kernel refuses to create any of them
+    PollTimeGate() 
+        : EventFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC), "eventfd"),
+          TimerFd(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC), "timerfd_create"),
+          EpollFd(epoll_create1(EPOLL_CLOEXEC), "epoll_create1")
+    {
+        for (const FileDescriptor* fd : { &EventFd, &TimerFd })
+        {
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.fd = fd->Get();
+            if (epoll_ctl(EpollFd.Get(), EPOLL_CTL_ADD, fd->Get(), &event) != 0)
+                throw std::system_error(errno, std::system_category(), "epoll_ctl");
+        }
+    }
+
+    // Returns the descriptor to wait on. It is readable while TryClose has something to report
+    int GetFd() const
+    {
+        return EpollFd.Get();
+    }
+
+    // Makes the descriptor readable and the next TryClose report Opened. 
+    // If called before waiting, then the next wait finishes immediately
+    void Open()
+    {
+        uint64_t value = 1;
+        ssize_t res = write(EventFd.Get(), &value, sizeof(value));
+        (void)res;
+    }
+
+    // Sets the deadline of the current wait. After it passes the descriptor becomes readable and TryClose reports TimedOut
+    template<class Clock, class Duration>
+    void ArmUntil(const std::chrono::time_point<Clock, Duration>& timePoint)
+    {
+        auto deadline = Futex::ToSteady(timePoint);
+
+        // A zero value would disarm the timer, so a deadline in the past fires after a nanosecond
+        auto sinceEpoch = std::max(std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()), std::chrono::nanoseconds(1));
+        itimerspec spec = {};
+        spec.it_value = Futex::ToTimespec(sinceEpoch);
+        SetTimer(spec);
+    }
+
+    // Sets the deadline of the current wait relative to now
+    template<class Rep, class Period>
+    void ArmFor(const std::chrono::duration<Rep, Period>& duration)
+    {
+        ArmUntil(std::chrono::steady_clock::now() + duration);
+    }
+
+    // Removes the deadline of the current wait
+    void Disarm()
+    {
+        itimerspec spec = {};
+        SetTimer(spec);
+        Drain(TimerFd);
+    }
+
+    // Never blocks the thread. Consumes the Open call or the passed deadline, whichever is available, and reports it. 
+    // Open takes precedence over the deadline and removes it. After a timeout the gate remains active, like TimeGate does
+    Result TryClose()
+    {
+        if (Drain(EventFd))
+        {
+            Disarm();
+            return Result::Opened;
+        }
+
+        if (Drain(TimerFd))
+            return Result::TimedOut;
+
+        return Result::None;
+    }
+
+    // Blocks the thread until the gate is opened or the deadline passes. For threads that are not in an event loop
+    Result Close()
+    {
+        while (true)
+        {
+            Result result = TryClose();
+            if (result != Result::None)
+                return result;
+
+            pollfd fd = {};
+            fd.fd = EpollFd.Get();
+            fd.events = POLLIN;
+            poll(&fd, 1, -1);
+        }
+    }
+};
+
+// This class implements a gate on top of an eventfd, so reactor threads can wait on it in poll, epoll or io_uring 
+// together with sockets. Open writes to the eventfd, the descriptor is readable while the gate is opened. 
+// Several Open calls before Close are merged, like in Gate. Doesn't make sense when working in more than two threads
+class EventGate
+{
+private:
+    FileDescriptor EventFd;
+public:
+    // Creates the eventfd. Throws std::system_error if the kernel refuses to create it
+    EventGate() : EventFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC), "eventfd") {}
+
+    // Returns the descriptor to wait on. It is readable while the gate is opened
+    int GetFd() const
+    {
+        return EventFd.Get();
+    }
+
+    // Opens the gate and makes the descriptor readable. If called before the Close method, then the Close method will not block the thread
+    void Open()
+    {
+        uint64_t value = 1;
+        ssize_t res = write(EventFd.Get(), &value, sizeof(value));
+        (void)res;
+    }
+
+    // Consumes the Open calls made so far with a single read syscall and never blocks the thread. Returns true if the gate was opened
+    bool TryClose()
+    {
+        uint64_t value;
+        return read(EventFd.Get(), &value, sizeof(value)) == sizeof(value);
+    }
+
+    // Blocks the execution of the thread until the Open method is called. 
+    // If the Open method was called before this method, then the thread is not blocked
+    void Close()
+    {
+        while (!TryClose())
+        {
+            pollfd fd = {};
+            fd.fd = EventFd.Get();
+            fd.events = POLLIN;
+            poll(&fd, 1, -1);
+        }
+    }
+};
+
+// This class implements a counting gate on top of an eventfd, so reactor threads can wait on it in poll, epoll or io_uring 
+// together with sockets. The permit counter of RecursiveGate maps onto the eventfd counter: Open adds permits to it 
+// and a single read takes all permits collected so far as one batch. Doesn't make sense when working in more than two threads
+class EventRecursiveGate
+{
+private:
+    FileDescriptor EventFd;
+public:
+    // Creates the eventfd. Throws std::system_error if the kernel refuses to create it
+    EventRecursiveGate() : EventFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC), "eventfd") {}
+
+    // Returns the descriptor to wait on. It is readable while there are permits
+    int GetFd() const
+    {
+        return EventFd.Get();
+    }
+
+    // Adds amount permits with a single write syscall
+    void Open(uint32_t amount = 1)
+    {
+        uint64_t value = amount;
+        ssize_t res = write(EventFd.Get(), &value, sizeof(value));
+        (void)res;
+    }
+
+    // Takes all available permits with a single read syscall and never blocks the thread. Returns the amount of taken permits
+    uint64_t TryClose()
+    {
+        uint64_t value;
+        if (read(EventFd.Get(), &value, sizeof(value)) != sizeof(value))
+            return 0;
+        return value;
+    }
+
+    // Blocks the execution of the thread until at least one permit is available and takes all available permits. 
+    // Returns the amount of taken permits
+    uint64_t Close()
+    {
+        while (true)
+        {
+            uint64_t taken = TryClose();
+            if (taken != 0)
+                return taken;
+
+            pollfd fd = {};
+            fd.fd = EventFd.Get();
+            fd.events = POLLIN;
+            poll(&fd, 1, -1);
+        }
+    }
+};
+
+// This class implements a gate that a thread driving io_uring can wait on in its own completion queue. 
+// On Linux 6.7+ the wait is an IORING_OP_FUTEX_WAIT on the gate word, so Open wakes the ring directly. 
+// On older kernels the gate falls back to an eventfd and the wait is an IORING_OP_POLL_ADD on it. 
+// The ring itself belongs to the caller: the gate only fills submission entries and interprets completions. 
+// Doesn't make sense when working in more than two threads
+class RingGate : private Gate
+{
+private:
+    // io_uring futex opcodes and futex2 flags, spelled out for kernel headers older than 6.7
+    static constexpr uint8_t RingOpFutexWait = 51;
+    static constexpr uint32_t Futex2SizeU32 = 0x02;
+    static constexpr uint32_t Futex2Private = FUTEX_PRIVATE_FLAG;
+
+    std::optional<EventGate> FallbackGate;
+
+    // Asks the kernel whether io_uring supports futex waits. Creates a throwaway ring once per process
+    static bool ProbeFutexWait()
+    {
+        io_uring_params params = {};
+        long ringFd = syscall(__NR_io_uring_setup, 1, &params);
+        if (ringFd < 0)
+            return false;
+
+        FileDescriptor ring(static_cast<int>(ringFd), "io_uring_setup");
+        constexpr unsigned OpCount = 256;
+        alignas(io_uring_probe) unsigned char buffer[sizeof(io_uring_probe) + OpCount * sizeof(io_uring_probe_op)] = {};
+        io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer);
+        if (syscall(__NR_io_uring_register, ring.Get(), IORING_REGISTER_PROBE, probe, OpCount) < 0)
+            return false;
+
+        return probe->last_op >= RingOpFutexWait && (probe->ops[RingOpFutexWait].flags & IO_URING_OP_SUPPORTED) != 0;
+    }
+public:
+    enum class Backend { Auto, EventFd };
+
+    // Chooses the futex or the eventfd backend depending on the running kernel, or always the eventfd one. 
+    // Throws std::system_error if the eventfd backend is needed and can't be created
+    explicit RingGate(Backend backend = Backend::Auto)
+    {
+        static const bool isFutexWaitSupported = ProbeFutexWait();
+        if (!isFutexWaitSupported || backend == Backend::EventFd)
+            FallbackGate.emplace();
+    }
+
+    // Returns true if the gate is waited on with IORING_OP_FUTEX_WAIT and false if it falls back to an eventfd
+    bool IsFutexBacked() const
+    {
+        return !FallbackGate;
+    }
+
+    // Fills the submission entry that completes when the gate is opened. Returns false if the gate is already opened: 
+    // then the Open call is consumed and nothing has to be submitted
+    bool PrepareClose(io_uring_sqe& sqe, uint64_t userData)
     {
-        std::unique_lock<std::mutex> lk(lockMutex);
-        mtx.lock();
-        if (IsActivated)
+        if (FallbackGate)
         {
-            condVarMutex.lock();
-            mtx.unlock();
-            cv.wait(lk);
-            condVarMutex.unlock();
-            mtx.lock();
+            if (FallbackGate->TryClose())
+                return false;
+
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_POLL_ADD;
+            sqe.fd = FallbackGate->GetFd();
+            sqe.poll32_events = POLLIN;
+            sqe.user_data = userData;
+            return true;
         }
-        else
+
+        if (TryCloseFast())
+            return false;
+
+        // Announce the sleeping closer, so Open issues the wake that completes the ring entry
+        uint32_t state = State.load(std::memory_order_relaxed);
+        while (state != Sleeping)
         {
-            IsActivated = true;
+            if (state == Opened)
+            {
+                if (State.compare_exchange_weak(state, Closed, std::memory_order_acquire, std::memory_order_relaxed))
+                    return false;
+            }
+            else if (State.compare_exchange_weak(state, Sleeping, std::memory_order_relaxed, std::memory_order_relaxed))
+                state = Sleeping;
         }
-        mtx.unlock();
+
+        Count(SlowCloses);
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = RingOpFutexWait;
+        sqe.fd = static_cast<int32_t>(Futex2SizeU32 | Futex2Private);
+        sqe.addr = reinterpret_cast<uint64_t>(&State);
+        sqe.addr2 = Sleeping;
+        sqe.addr3 = FUTEX_BITSET_MATCH_ANY;
+        sqe.user_data = userData;
+        return true;
     }
 
-    // Causes the thread to continue executing after the Close method. 
-    // If called before the Close method, then the Close method will not block the thread.
-    // The Close and Open methods are synchronized with each other using a mutex
-    void Open()
+    // Interprets the completion of the entry filled by PrepareClose. Returns true if the gate was opened and the Open 
+    // call is consumed. Returns false if the gate is not opened yet: then the entry must be prepared and submitted again. 
+    // A cancelled entry withdraws the waiting closer. Throws std::system_error if the kernel rejected the entry
+    bool CompleteClose(const io_uring_cqe& cqe)
     {
-        mtx.lock();
-        if (condVarMutex.try_lock())
+        if (FallbackGate)
         {
-            IsActivated = false;
-            condVarMutex.unlock();
+            if (cqe.res < 0 && cqe.res != -ECANCELED)
+                throw std::system_error(-cqe.res, std::system_category(), "io_uring poll");
+            return FallbackGate->TryClose();
         }
-        else
-        {
-            while (condVarMutex.try_lock() != true)
-                cv.notify_all();
 
-            condVarMutex.unlock();
+        // A wake completes with 0, and -EAGAIN means the word had already left Sleeping, both may be an Open. 
+        // Any other result means the kernel never waited, so the announcement is withdrawn
+        if (cqe.res < 0 && cqe.res != -EAGAIN)
+        {
+            uint32_t state = Sleeping;
+            State.compare_exchange_strong(state, Closed, std::memory_order_relaxed, std::memory_order_relaxed);
+            if (cqe.res != -ECANCELED)
+                throw std::system_error(-cqe.res, std::system_category(), "io_uring futex wait");
         }
-        mtx.unlock();
+        return TryConsume();
+    }
+
+    // Causes the ring entry prepared by PrepareClose to complete. 
+    // If called before PrepareClose, then PrepareClose will consume it and return false
+    void Open()
+    {
+        if (FallbackGate)
+            FallbackGate->Open();
+        else
+            Gate::Open();
     }
 };
+#endif
 
-// This class implements a gate for a thread. It works as condition variable, 
-// but if the Open method was called in another thread before the Close method, 
-// then the Close method will not block the thread. Doesn't make sense when working in more than two threads. 
-// Supports opening and closing counter. You can call the Open method N times and then the 
-// Close method will block the execution of the thread only for N call
-class RecursiveGate
+// This class implements a gate that passes a value from the opening thread to the closing one. 
+// The Open method constructs the value inside the gate and opens it, the Close method waits and moves the value out, 
+// so the value travels with the wakeup without a lock or an allocation. Holds one value at a time: 
+// the next Open must come after the Close that took the previous value. Doesn't make sense when working in more than two threads
+template<class T>
+class ValueGate : private Gate
 {
 private:
-    std::mutex mtx, condVarMutex, lockMutex;
-    std::condition_variable cv;
-    int ClosingAmount = 0;
+    alignas(T) unsigned char Storage[sizeof(T)];
+
+    T* Value()
+    {
+        return std::launder(reinterpret_cast<T*>(Storage));
+    }
+
+    T Take()
+    {
+        T value(std::move(*Value()));
+        Value()->~T();
+        return value;
+    }
 public:
-    // Blocks the execution of the thread until the Open method is called. 
-    // If the Open method was called before this method, then the thread is not blocked.
-    // The Close and Open methods are synchronized with each other using a mutex
-    void Close()
+    ValueGate() = default;
+    ValueGate(const ValueGate&) = delete;
+    ValueGate& operator=(const ValueGate&) = delete;
+
+    // Destroys the value that was not taken
+    ~ValueGate()
     {
-        std::unique_lock<std::mutex> lk(lockMutex);
-        mtx.lock();
-        if (ClosingAmount <= 0)
+        if (State.load(std::memory_order_acquire) == Opened)
+            Value()->~T();
+    }
+
+    // Blocks the execution of the thread until the Open method is called and returns the value passed to it. 
+    // If the Open method was called before this method, then the thread is not blocked
+    T Close()
+    {
+        Gate::Close();
+        return Take();
+    }
+
+    // Returns the value if the Open method was called before, without blocking the thread
+    std::optional<T> TryClose()
+    {
+        if (!TryCloseFast())
+            return std::nullopt;
+
+        return Take();
+    }
+
+    // Constructs the value inside the gate from the arguments and causes the thread to continue executing after the Close method. 
+    // The previous value must have been taken: the gate merges two Opens, so the second one would overwrite a live value. 
+    // With one producer the check is reliable, so a second Open before Close throws std::logic_error and keeps the first value
+    template<class... Args>
+    void Emplace(Args&&... args)
+    {
+        bool isOpened = State.load(std::memory_order_relaxed) == Opened;
+        assert(!isOpened && "ValueGate holds one value at a time");
+        if (isOpened)
+            throw std::logic_error("ValueGate::Open: the previous value has not been taken");
+
+        new (Storage) T(std::forward<Args>(args)...);
+        Gate::Open();
+    }
+
+    // Causes the thread to continue executing after the Close method, which will return the value
+    void Open(T&& value)
+    {
+        Emplace(std::move(value));
+    }
+
+    // Causes the thread to continue executing after the Close method, which will return a copy of the value
+    void Open(const T& value)
+    {
+        Emplace(value);
+    }
+
+    using Gate::SetSpinLimit;
+};
+
+// This class implements a rate limiting gate. Permits refill with time at a fixed rate up to the burst capacity, 
+// and the Close method takes a permit, sleeping exactly until it is due. There is no background thread: 
+// the bucket is refilled lazily from the elapsed time whenever a permit is requested. Works with any number of threads
+class RateLimitGate
+{
+private:
+    // The bucket is kept as the monotonic time at which it was empty, in nanoseconds. The amount of permits 
+    // at the moment t is (t - EmptySince) / Interval, capped by the burst. Taking n permits moves the time by n intervals, 
+    // so a single compare-and-swap both refills the bucket and reserves the permits
+    std::atomic<int64_t> EmptySince;
+    int64_t IntervalNs;
+    int64_t BurstNs;
+
+    static int64_t NowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+public:
+    // Creates a full bucket. One permit is added every interval, at most burst permits are kept
+    template<class Rep, class Period>
+    explicit RateLimitGate(const std::chrono::duration<Rep, Period>& interval, uint32_t burst = 1)
+        : IntervalNs(std::max<int64_t>(1, std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count())),
+          BurstNs(IntervalNs * std::max<uint32_t>(1, burst))
+    {
+        EmptySince.store(NowNs() - BurstNs, std::memory_order_relaxed);
+    }
+
+    // Takes amount permits, blocking the thread exactly until they are due. 
+    // Permits are reserved before sleeping, so concurrent threads are served in the order of their reservations
+    void Close(uint32_t amount = 1)
+    {
+        int64_t now = NowNs();
+        int64_t emptySince = EmptySince.load(std::memory_order_relaxed);
+        int64_t dueTime;
+        do
         {
-            condVarMutex.lock();
-            mtx.unlock();
-            cv.wait(lk);
-            condVarMutex.unlock();
-            mtx.lock();
-        }
-        --ClosingAmount;
-        mtx.unlock();
+            dueTime = std::max(emptySince, now - BurstNs) + IntervalNs * amount;
+        } while (!EmptySince.compare_exchange_weak(emptySince, dueTime, std::memory_order_relaxed, std::memory_order_relaxed));
+
+        if (dueTime <= now)
+            return;
+
+#ifdef __linux__
+        timespec deadline = Futex::ToTimespec(std::chrono::nanoseconds(dueTime));
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR);
+#else
+        std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(dueTime))));
+#endif
     }
 
-    // Causes the thread to continue executing after the Close method. 
-    // If called before the Close method, then the Close method will not block the thread.
-    // The Close and Open methods are synchronized with each other using a mutex
-    void Open()
+    // Takes amount permits if they are available right now and never blocks the thread. Returns true if the permits were taken
+    bool TryClose(uint32_t amount = 1)
     {
-        mtx.lock();
-        if (!condVarMutex.try_lock())
+        int64_t now = NowNs();
+        int64_t emptySince = EmptySince.load(std::memory_order_relaxed);
+        int64_t dueTime;
+        do
         {
-            while (condVarMutex.try_lock() != true)
-                cv.notify_all();
+            dueTime = std::max(emptySince, now - BurstNs) + IntervalNs * amount;
+            if (dueTime > now)
+                return false;
+        } while (!EmptySince.compare_exchange_weak(emptySince, dueTime, std::memory_order_relaxed, std::memory_order_relaxed));
 
-            condVarMutex.unlock();
-        }
-        else
-            condVarMutex.unlock();
+        return true;
+    }
+};
 
-        ++ClosingAmount;
-        mtx.unlock();
+#ifdef __cpp_impl_coroutine
+// Coroutine type for the demonstration: starts at once and destroys its frame when it finishes
+struct DetachedCoroutine
+{
+    struct promise_type
+    {
+        DetachedCoroutine get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+#endif
+
+// Executor that queues the posted callables until they are run
+struct QueueExecutor
+{
+    std::vector<std::function<void()>> Tasks;
+
+    template<class F>
+    void execute(F&& callable)
+    {
+        Tasks.emplace_back(std::forward<F>(callable));
     }
 };
 
-// This class implements a gate for a thread. It works as condition variable, 
-// but if the Open method was called in another thread before the Close method, 
-// then the Close method will not block the thread. Doesn't make sense when working in more than two threads
-class TimeGate
+#if defined(__cpp_lib_jthread) && defined(__cpp_concepts)
+// Receiver that records how a gate sender completed: 1 opened, 2 timed out, 3 stopped
+struct RecordingReceiver
+{
+    std::atomic<int>* Completion;
+    std::stop_token Token;
+
+    void set_value() && { Completion->store(1); }
+    void set_value(bool isOpened) && { Completion->store(isOpened ? 1 : 2); }
+    void set_stopped() && { Completion->store(3); }
+    std::stop_token get_stop_token() const { return Token; }
+};
+#endif
+
+// Copy of the original mutex and condition variable handshake of Gate, kept to compare the opener CPU time with it. 
+// The closing thread reports when it is between taking condVarMutex and waiting on the condition variable 
+// and stays there for Preemption, as if the scheduler took the processor from it at that moment
+struct LegacyHandshakeGate
 {
-private:
     std::mutex mtx, condVarMutex, lockMutex;
     std::condition_variable cv;
     bool IsActivated = true;
-public:
-    // Blocks the execution of the thread until the Open method is called. 
-    // If the Open method was called before this method, then the thread is not blocked.
-    // The Close and Open methods are synchronized with each other using a mutex
+    std::atomic<bool> IsInWindow{false};
+    std::chrono::microseconds Preemption{200};
+
     void Close()
     {
         std::unique_lock<std::mutex> lk(lockMutex);
@@ -130,6 +2737,8 @@ public:
         {
             condVarMutex.lock();
             mtx.unlock();
+            IsInWindow = true;
+            std::this_thread::sleep_for(Preemption);
             cv.wait(lk);
             condVarMutex.unlock();
             mtx.lock();
@@ -141,91 +2750,194 @@ public:
         mtx.unlock();
     }
 
-    // Blocks the execution of the thread until the Open method is called or time's not up.
-    // If the Open method was called before this method, then the thread is not blocked.
-    // The Close and Open methods are synchronized with each other using a mutex.
-    // After the time expires, the gate remains active, which means that the following Close method will block the thread.
-    template<class T>
-    void CloseFor(std::chrono::duration<T> duration)
+    void Open()
     {
-        std::unique_lock<std::mutex> lk(lockMutex);
         mtx.lock();
-        if (IsActivated)
+        if (condVarMutex.try_lock())
         {
-            condVarMutex.lock();
-            mtx.unlock();
-            cv.wait_for(lk, duration);
+            IsActivated = false;
             condVarMutex.unlock();
-            mtx.lock();
         }
         else
         {
-            IsActivated = true;
+            while (condVarMutex.try_lock() != true)
+                cv.notify_all();
+
+            condVarMutex.unlock();
         }
         mtx.unlock();
     }
+};
 
-    // Blocks the execution of the thread until the Open method is called or the time has come for.
-    // If the Open method was called before this method, then the thread is not blocked.
-    // The Close and Open methods are synchronized with each other using a mutex.
-    // After the time expires, the gate remains active, which means that the following Close method will block the thread.
-    template<class T>
-    void CloseUntil(std::chrono::time_point<T> timePoint)
+// Gate whose closing thread is held in the same window: it has announced itself on the word, but is not asleep yet
+struct PreemptedCloseGate : Gate
+{
+    std::atomic<bool> IsInWindow{false};
+    std::chrono::microseconds Preemption{200};
+
+    void Close()
     {
-        std::unique_lock<std::mutex> lk(lockMutex);
-        mtx.lock();
-        if (IsActivated)
+        uint32_t state = Closed;
+        if (State.compare_exchange_strong(state, Sleeping, std::memory_order_relaxed, std::memory_order_relaxed))
         {
-            condVarMutex.lock();
-            mtx.unlock();
-            cv.wait_until(lk, timePoint);
-            condVarMutex.unlock();
-            mtx.lock();
+            IsInWindow = true;
+            std::this_thread::sleep_for(Preemption);
+            while (State.load(std::memory_order_relaxed) == Sleeping)
+                Futex::Wait(State, Sleeping);
         }
-        else
+        TryConsume();
+    }
+};
+
+// Returns the average thread CPU time of Open when the closing thread is preempted right before it falls asleep
+template<class TestGate>
+std::chrono::nanoseconds MeasurePreemptedOpen(int handoffs)
+{
+    TestGate request;
+    Gate response;
+    std::thread closer([&]()
+    {
+        for (int i = 0; i < handoffs; ++i)
         {
-            IsActivated = true;
+            request.Close();
+            response.Open();
         }
-        mtx.unlock();
+    });
+
+    std::chrono::nanoseconds openerCpuTime(0);
+    for (int i = 0; i < handoffs; ++i)
+    {
+        while (!request.IsInWindow.load())
+            std::this_thread::yield();
+        request.IsInWindow = false;
+
+        timespec start, end;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+        request.Open();
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+        openerCpuTime += std::chrono::seconds(end.tv_sec - start.tv_sec) + std::chrono::nanoseconds(end.tv_nsec - start.tv_nsec);
+        response.Close();
     }
 
-    // Causes the thread to continue executing after the Close method. 
-    // If called before the Close method or after CloseFor time expires, then the Close method will not block the thread.
-    // The Close and Open methods are synchronized with each other using a mutex
-    void Open()
+    closer.join();
+    return openerCpuTime / handoffs;
+}
+
+#ifdef __linux__
+// Minimal io_uring instance for the RingGate demo, without liburing: one entry is submitted and completed at a time
+class DemoRing
+{
+private:
+    io_uring_params Params = {};
+    FileDescriptor RingFd;
+    size_t SqSize, CqSize, SqesSize;
+    void* SqRing;
+    void* CqRing;
+    io_uring_sqe* Sqes;
+    unsigned *SqTail, *SqMask, *SqArray, *CqHead, *CqTail, *CqMask;
+    io_uring_cqe* Cqes;
+
+    void* Map(size_t size, off_t offset)
     {
-        mtx.lock();
-        if (condVarMutex.try_lock())
-        {   
-            IsActivated = false;
-            condVarMutex.unlock();
-        }
-        else
-        {
-            while (condVarMutex.try_lock() != true)
-                cv.notify_all();
+        void* ring = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, RingFd.Get(), offset);
+        if (ring == MAP_FAILED)
+            throw std::system_error(errno, std::system_category(), "mmap");
+        return ring;
+    }
+public:
+    DemoRing() : RingFd(static_cast<int>(syscall(__NR_io_uring_setup, 4, &Params)), "io_uring_setup")
+    {
+        SqSize = Params.sq_off.array + Params.sq_entries * sizeof(unsigned);
+        CqSize = Params.cq_off.cqes + Params.cq_entries * sizeof(io_uring_cqe);
+        SqesSize = Params.sq_entries * sizeof(io_uring_sqe);
+        SqRing = Map(SqSize, IORING_OFF_SQ_RING);
+        CqRing = Map(CqSize, IORING_OFF_CQ_RING);
+        Sqes = static_cast<io_uring_sqe*>(Map(SqesSize, IORING_OFF_SQES));
 
-            condVarMutex.unlock();
-        }
-        mtx.unlock();
+        char* sq = static_cast<char*>(SqRing);
+        char* cq = static_cast<char*>(CqRing);
+        SqTail = reinterpret_cast<unsigned*>(sq + Params.sq_off.tail);
+        SqMask = reinterpret_cast<unsigned*>(sq + Params.sq_off.ring_mask);
+        SqArray = reinterpret_cast<unsigned*>(sq + Params.sq_off.array);
+        CqHead = reinterpret_cast<unsigned*>(cq + Params.cq_off.head);
+        CqTail = reinterpret_cast<unsigned*>(cq + Params.cq_off.tail);
+        CqMask = reinterpret_cast<unsigned*>(cq + Params.cq_off.ring_mask);
+        Cqes = reinterpret_cast<io_uring_cqe*>(cq + Params.cq_off.cqes);
     }
 
-    // Causes the thread to continue executing after the CloseFor method. If the time is over before this method is called, then it will not do anything
-    // If called before the Close method, then the Close method will block the thread.
-    // The Close and Open methods are synchronized with each other using a mutex
-    void OpenIfClosed()
+    DemoRing(const DemoRing&) = delete;
+    DemoRing& operator=(const DemoRing&) = delete;
+
+    ~DemoRing()
     {
-        mtx.lock();
+        munmap(Sqes, SqesSize);
+        munmap(CqRing, CqSize);
+        munmap(SqRing, SqSize);
+    }
+
+    // Returns the next free submission entry
+    io_uring_sqe& NextEntry()
+    {
+        unsigned index = *SqTail & *SqMask;
+        SqArray[index] = index;
+        return Sqes[index];
+    }
 
-        while (condVarMutex.try_lock() != true)
-            cv.notify_all();
+    // Submits the entry returned by NextEntry and waits for its completion
+    io_uring_cqe SubmitAndWait()
+    {
+        __atomic_store_n(SqTail, *SqTail + 1, __ATOMIC_RELEASE);
+        if (syscall(__NR_io_uring_enter, RingFd.Get(), 1, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+            throw std::system_error(errno, std::system_category(), "io_uring_enter");
 
-        condVarMutex.unlock();
-        
-        mtx.unlock();
+        unsigned head = *CqHead;
+        while (head == __atomic_load_n(CqTail, __ATOMIC_ACQUIRE))
+            syscall(__NR_io_uring_enter, RingFd.Get(), 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+
+        io_uring_cqe cqe = Cqes[head & *CqMask];
+        __atomic_store_n(CqHead, head + 1, __ATOMIC_RELEASE);
+        return cqe;
     }
 };
 
+// Passes the Opens of another thread through a ring in a request and acknowledge loop. 
+// Returns how many of them completed a submitted entry instead of being consumed by PrepareClose at once
+int RunRingHandoffs(RingGate& gate, int handoffs)
+{
+    DemoRing ring;
+    Gate ack;
+    std::thread opener([&]()
+    {
+        for (int i = 0; i < handoffs; ++i)
+        {
+            gate.Open();
+            ack.Close();
+        }
+    });
+
+    int completedInRing = 0;
+    for (int i = 0; i < handoffs; ++i)
+    {
+        while (true)
+        {
+            io_uring_sqe& sqe = ring.NextEntry();
+            if (!gate.PrepareClose(sqe, static_cast<uint64_t>(i)))
+                break;
+
+            if (gate.CompleteClose(ring.SubmitAndWait()))
+            {
+                ++completedInRing;
+                break;
+            }
+        }
+        ack.Open();
+    }
+
+    opener.join();
+    return completedInRing;
+}
+#endif
+
 int main()
 {
     Gate g;
@@ -249,6 +2961,9 @@ int main()
 
     std::cout << "Regular gates" << std::endl;
 
+    Gate::Stats stats = g.GetStats();
+    std::cout << "Fast closes: " << stats.FastCloses << ", slow closes: " << stats.SlowCloses << std::endl;
+
     RecursiveGate rg;
     
     std::thread th3([&]()
@@ -261,7 +2976,22 @@ int main()
 
     th3.join();
 
+    rg.Open(1000);
+    rg.Close(600);
+    std::cout << "Permits left after batch close: " << rg.TryClose(1000) << std::endl;
+
+    rg.Open(3);
+    std::cout << "Permits taken before deadline: " << rg.CloseFor(5, std::chrono::milliseconds(10)) << std::endl;
+
+    rg.Open(1);
+    std::cout << "Permits taken before a deadline before boot: " << rg.CloseUntil(2, std::chrono::system_clock::time_point{}) << std::endl;
+
     std::cout << "Recursive gates" << std::endl;
+
+    std::chrono::nanoseconds openerCpuTime = MeasurePreemptedOpen<PreemptedCloseGate>(50);
+    std::chrono::nanoseconds legacyOpenerCpuTime = MeasurePreemptedOpen<LegacyHandshakeGate>(50);
+    std::cout << "Opener CPU time with a preempted closer: " << openerCpuTime.count() << " ns per Open, " 
+        << legacyOpenerCpuTime.count() << " ns with the old notify_all handshake" << std::endl;
     
     TimeGate tg;
 
@@ -273,4 +3003,182 @@ int main()
 
     tg.CloseUntil(now + std::chrono::seconds(5));
     std::cout << "Time gate until" << std::endl;
-}
\ No newline at end of file
+
+    if (!tg.CloseUntil(std::chrono::system_clock::time_point{}) && !tg.CloseFor(-std::chrono::hours(24 * 365 * 100)))
+        std::cout << "Time gate with a deadline before boot" << std::endl;
+
+    tg.Open();
+    if (tg.CloseFor(std::chrono::microseconds(200)) && !tg.CloseFor(std::chrono::microseconds(200)))
+        std::cout << "Time gate with microsecond timeout" << std::endl;
+
+    tg.SetSlack(std::chrono::milliseconds(5));
+    if (!tg.CloseFor(std::chrono::milliseconds(1)))
+        std::cout << "Time gate with slack" << std::endl;
+    tg.SetSlack(std::chrono::nanoseconds(0));
+
+    TimerWheel wheel;
+    if (!tg.CloseFor(std::chrono::milliseconds(20), wheel))
+        std::cout << "Time gate with timer wheel" << std::endl;
+
+    TickerGate ticker(std::chrono::milliseconds(5));
+    ticker.CloseTick();
+    std::this_thread::sleep_for(std::chrono::milliseconds(12));
+    std::cout << "Ticker gate missed " << ticker.CloseTick().MissedTicks << " ticks" << std::endl;
+
+    MultiGate mg;
+    std::vector<std::thread> workers;
+    for (int i = 0; i < 3; ++i)
+        workers.emplace_back([&]()
+        {
+            mg.Close();
+        });
+
+    for (int i = 0; i < 3; ++i)
+        mg.Open();
+
+    for (auto& worker : workers)
+        worker.join();
+
+    std::cout << "Multi gates" << std::endl;
+
+    BroadcastGate bg;
+    workers.clear();
+    for (int i = 0; i < 3; ++i)
+        workers.emplace_back([&]()
+        {
+            bg.Close();
+        });
+
+    bg.Open();
+    bg.Close();
+
+    for (auto& worker : workers)
+        worker.join();
+
+    bg.Reset();
+
+    std::cout << "Broadcast gates" << std::endl;
+
+#ifdef __linux__
+    PollTimeGate ptg;
+    ptg.ArmFor(std::chrono::milliseconds(10));
+    epoll_event event;
+    FileDescriptor loop(epoll_create1(EPOLL_CLOEXEC), "epoll_create1");
+    event.events = EPOLLIN;
+    event.data.fd = ptg.GetFd();
+    epoll_ctl(loop.Get(), EPOLL_CTL_ADD, ptg.GetFd(), &event);
+    if (epoll_wait(loop.Get(), &event, 1, -1) == 1 && ptg.TryClose() == PollTimeGate::Result::TimedOut)
+        std::cout << "Poll time gate" << std::endl;
+
+    EventGate eg;
+    EventRecursiveGate erg;
+    eg.Open();
+    erg.Open(3);
+    erg.Open(4);
+    pollfd eventFds[2] = {};
+    eventFds[0].fd = eg.GetFd();
+    eventFds[1].fd = erg.GetFd();
+    eventFds[0].events = eventFds[1].events = POLLIN;
+    if (poll(eventFds, 2, -1) == 2 && eg.TryClose() && !eg.TryClose())
+        std::cout << "Event gates, permits in one read: " << erg.TryClose() << std::endl;
+
+    RingGate ringGate, eventFdRingGate(RingGate::Backend::EventFd);
+    std::cout << "Ring gate backed by " << (ringGate.IsFutexBacked() ? "futex" : "eventfd") << ": " 
+        << RunRingHandoffs(ringGate, 2000) << " of 2000 Opens completed in the ring, eventfd backend: " 
+        << RunRingHandoffs(eventFdRingGate, 2000) << std::endl;
+#endif
+
+    RateLimitGate limiter(std::chrono::milliseconds(10), 5);
+    auto limiterStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < 10; ++i)
+        limiter.Close();
+
+    std::cout << "Rate limit gate: 10 permits in " 
+        << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - limiterStart).count() << " ms" << std::endl;
+
+#ifdef __cpp_impl_coroutine
+    Gate cg;
+    RecursiveGate crg;
+    int resumedCoroutines = 0;
+    auto gateCoroutine = [&]() -> DetachedCoroutine
+    {
+        co_await cg.AsyncClose();
+        co_await crg.AsyncClose(2);
+        ++resumedCoroutines;
+    };
+
+    gateCoroutine();
+    cg.Open();
+    crg.Open();
+    crg.Open();
+    if (resumedCoroutines == 1)
+        std::cout << "Coroutine gates" << std::endl;
+#endif
+
+#if defined(__cpp_lib_jthread) && defined(__cpp_concepts)
+    Gate senderGate;
+    TimeGate senderTimeGate;
+    RecursiveGate senderRecursiveGate;
+    TimerWheel senderWheel;
+    std::stop_source stopSource;
+    std::atomic<int> openedCompletion{0}, timedCompletion{0}, stoppedCompletion{0};
+
+    auto openedOperation = senderGate.AsyncCloseSender().connect(RecordingReceiver{&openedCompletion, {}});
+    auto timedOperation = senderTimeGate.AsyncCloseForSender(std::chrono::milliseconds(5), senderWheel).connect(RecordingReceiver{&timedCompletion, {}});
+    auto stoppedOperation = senderRecursiveGate.AsyncCloseSender(2).connect(RecordingReceiver{&stoppedCompletion, stopSource.get_token()});
+    openedOperation.start();
+    timedOperation.start();
+    stoppedOperation.start();
+
+    senderGate.Open();
+    senderRecursiveGate.Open();
+    stopSource.request_stop();
+    while (timedCompletion.load() == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    if (openedCompletion.load() == 1 && timedCompletion.load() == 2 && stoppedCompletion.load() == 3 && senderRecursiveGate.TryClose(2) == 1)
+        std::cout << "Sender gates" << std::endl;
+#endif
+
+    ContinuationGate continuationGate;
+    QueueExecutor executor;
+    int continuations = 0;
+    continuationGate.Open();
+    continuationGate.OnOpen([&continuations]() { ++continuations; });
+    continuationGate.OnOpen([&continuations]() { ++continuations; }, executor);
+    continuationGate.Open();
+    for (std::function<void()>& task : executor.Tasks)
+        task();
+
+    if (continuations == 2)
+        std::cout << "Continuation gates" << std::endl;
+
+    ValueGate<std::string> valueGate;
+    std::thread valueThread([&valueGate]() { valueGate.Open(std::string("response")); });
+    std::cout << "Value gate: " << valueGate.Close() << std::endl;
+    valueThread.join();
+
+    Gate workGate, shutdownGate;
+    TimeGate reloadGate;
+    std::thread shutdownThread([&shutdownGate]()
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        shutdownGate.Open();
+    });
+    std::cout << "Wait any: gate " << Gate::WaitAny(workGate, shutdownGate, reloadGate) << std::endl;
+    shutdownThread.join();
+
+    Gate firstPart, secondPart, thirdPart;
+    bool isJoinTimedOut = !Gate::WaitAllFor(std::chrono::milliseconds(5), firstPart, secondPart, thirdPart) && 
+        !Gate::WaitAllUntil(std::chrono::system_clock::time_point{}, firstPart, secondPart);
+    std::thread partsThread([&]()
+    {
+        firstPart.Open();
+        secondPart.Open();
+        thirdPart.Open();
+    });
+    Gate::WaitAll(firstPart, secondPart, thirdPart);
+    partsThread.join();
+    if (isJoinTimedOut)
+        std::cout << "Wait all" << std::endl;
+}